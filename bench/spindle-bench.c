@@ -0,0 +1,1243 @@
+/* Spindle: Co-reference aggregation engine
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* Required for nftw() */
+#define _XOPEN_SOURCE                   700
+
+/* spindle-bench: an offline benchmark harness for spindle-generate
+ *
+ * The harness loads the spindle-generate module in the same way as Twine
+ * does, but itself provides the Twine and SPARQL client APIs which the
+ * module uses: configuration comes from the command-line, and SPARQL queries
+ * are evaluated against an in-memory librdf store holding a synthetic (or
+ * recorded) corpus, so that no quad-store, database or network is needed.
+ * Each entity is generated as if by "twine -u spindle <uri>", with the cache
+ * in a temporary directory, and the throughput, per-stage timings (from the
+ * module's statistics file) and peak RSS are reported.
+ *
+ * The module must be linked so that its references to the Twine and SPARQL
+ * client APIs are resolved against this executable, which is built with
+ * -export-dynamic for that purpose.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <ftw.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <libtwine.h>
+#include <libsparqlclient.h>
+
+#define BENCH_ROOT                      "http://bench.invalid/"
+#define BENCH_COUNT                     1000
+
+#define NS_RDF                          "http://www.w3.org/1999/02/22-rdf-syntax-ns#"
+#define NS_RDFS                         "http://www.w3.org/2000/01/rdf-schema#"
+#define NS_OWL                          "http://www.w3.org/2002/07/owl#"
+#define NS_FOAF                         "http://xmlns.com/foaf/0.1/"
+#define NS_DCTERMS                      "http://purl.org/dc/terms/"
+
+struct sparql_struct
+{
+	librdf_model *model;
+};
+
+struct sparqlrow_struct
+{
+	librdf_node **nodes;
+	int count;
+};
+
+struct sparqlres_struct
+{
+	librdf_query *query;
+	librdf_query_results *results;
+	struct sparqlrow_struct row;
+	int started;
+};
+
+struct bench_config_struct
+{
+	char *key;
+	char *value;
+};
+
+struct bench_buf_struct
+{
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+static int bench_usage_(const char *progname);
+static int bench_config_set_(const char *key, const char *value);
+static int bench_corpus_generate_(librdf_model *model, const char *root, int count);
+static int bench_corpus_load_(librdf_model *model, const char *path);
+static char **bench_entities_(librdf_model *model, const char *root, int limit, size_t *count);
+static int bench_report_(const char *statspath, size_t entities, unsigned long failed, double elapsed);
+static int bench_buf_append_(struct bench_buf_struct *buf, const char *str, size_t len);
+static int bench_buf_node_(struct bench_buf_struct *buf, librdf_node *node);
+static char *bench_vformat_(const char *format, va_list ap);
+static librdf_query_results *bench_query_(SPARQL *sparql, const char *query, size_t length, librdf_query **queryp);
+static void bench_row_clear_(SPARQLRES *res);
+static char *bench_serialize_(librdf_model *model, const char *name, size_t *buflen);
+static int bench_rmtree_(const char *path, const struct stat *sb, int flag, struct FTW *ftw);
+static int bench_compare_(const void *a, const void *b);
+
+static librdf_world *world;
+static librdf_model *store;
+static struct bench_config_struct *config;
+static size_t nconfig;
+static int loglevel = LOG_WARNING;
+static unsigned long updates;
+static int (*update_fn)(const char *name, const char *identifier, void *data);
+static void *update_data;
+
+int
+main(int argc, char **argv)
+{
+	const char *corpus, *module, *root;
+	char tmpdir[64], path[128], *value, **entities;
+	int c, count, keep;
+	size_t n, i;
+	unsigned long failed;
+	void *handle;
+	int (*plugin_init)(void);
+	int (*plugin_done)(void);
+	struct timespec start, end;
+	double elapsed;
+
+	corpus = NULL;
+	module = SPINDLE_BENCH_MODULE;
+	root = BENCH_ROOT;
+	count = BENCH_COUNT;
+	keep = 0;
+	while((c = getopt(argc, argv, "hkvc:m:n:o:r:")) != -1)
+	{
+		switch(c)
+		{
+		case 'h':
+			bench_usage_(argv[0]);
+			return 0;
+		case 'k':
+			keep = 1;
+			break;
+		case 'v':
+			loglevel++;
+			break;
+		case 'c':
+			corpus = optarg;
+			break;
+		case 'm':
+			module = optarg;
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'o':
+			value = strchr(optarg, '=');
+			if(!value)
+			{
+				fprintf(stderr, "%s: configuration options must be in the form 'section:key=value'\n", argv[0]);
+				return 1;
+			}
+			*value = 0;
+			value++;
+			bench_config_set_(optarg, value);
+			break;
+		case 'r':
+			root = optarg;
+			break;
+		default:
+			bench_usage_(argv[0]);
+			return 1;
+		}
+	}
+	if(count < 1 || optind != argc)
+	{
+		bench_usage_(argv[0]);
+		return 1;
+	}
+	strcpy(tmpdir, "/tmp/spindle-bench.XXXXXX");
+	if(!mkdtemp(tmpdir))
+	{
+		fprintf(stderr, "%s: failed to create temporary directory: %s\n", argv[0], strerror(errno));
+		return 1;
+	}
+	/* Defaults, unless overridden on the command-line */
+	bench_config_set_("spindle:graph", root);
+	bench_config_set_("spindle:rulebase", SPINDLE_BENCH_RULEBASE);
+	snprintf(path, sizeof(path), "file://%s/cache/", tmpdir);
+	bench_config_set_("spindle:cache", path);
+	snprintf(path, sizeof(path), "%s/stats.prom", tmpdir);
+	bench_config_set_("spindle:stats-file", path);
+	bench_config_set_("spindle:stats-interval", "86400");
+
+	world = librdf_new_world();
+	librdf_world_open(world);
+	store = twine_rdf_model_create();
+	if(!store)
+	{
+		fprintf(stderr, "%s: failed to create in-memory store\n", argv[0]);
+		return 1;
+	}
+	if(corpus)
+	{
+		if(bench_corpus_load_(store, corpus))
+		{
+			return 1;
+		}
+	}
+	else if(bench_corpus_generate_(store, root, count))
+	{
+		return 1;
+	}
+	entities = bench_entities_(store, root, count, &n);
+	if(!entities || !n)
+	{
+		fprintf(stderr, "%s: the corpus contains no proxies in the root graph <%s>\n", argv[0], root);
+		return 1;
+	}
+	fprintf(stderr, "%s: %d triples in corpus; generating %lu entities\n", argv[0], librdf_model_size(store), (unsigned long) n);
+
+	handle = dlopen(module, RTLD_NOW | RTLD_GLOBAL);
+	if(!handle)
+	{
+		fprintf(stderr, "%s: failed to load %s: %s\n", argv[0], module, dlerror());
+		return 1;
+	}
+	plugin_init = (int (*)(void)) dlsym(handle, "twine_plugin_init");
+	plugin_done = (int (*)(void)) dlsym(handle, "twine_plugin_done");
+	if(!plugin_init || !plugin_done)
+	{
+		fprintf(stderr, "%s: %s is not a Twine plug-in\n", argv[0], module);
+		return 1;
+	}
+	if(plugin_init() || !update_fn)
+	{
+		fprintf(stderr, "%s: failed to initialise %s\n", argv[0], module);
+		return 1;
+	}
+	failed = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < n; i++)
+	{
+		if(update_fn("spindle", entities[i], update_data))
+		{
+			failed++;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+	/* Clean-up writes the final statistics */
+	plugin_done();
+	snprintf(path, sizeof(path), "%s/stats.prom", tmpdir);
+	bench_report_(path, n, failed, elapsed);
+	for(i = 0; i < n; i++)
+	{
+		free(entities[i]);
+	}
+	free(entities);
+	twine_rdf_model_destroy(store);
+	librdf_free_world(world);
+	if(keep)
+	{
+		fprintf(stderr, "%s: output has been left in %s\n", argv[0], tmpdir);
+	}
+	else
+	{
+		nftw(tmpdir, bench_rmtree_, 16, FTW_DEPTH | FTW_PHYS);
+	}
+	return failed ? 2 : 0;
+}
+
+static int
+bench_usage_(const char *progname)
+{
+	fprintf(stderr, "Usage: %s [OPTIONS]\n"
+			"\n"
+			"OPTIONS is one or more of:\n"
+			"  -h                   Print this usage message and exit\n"
+			"  -n COUNT             Generate COUNT entities (default %d)\n"
+			"  -c FILE              Load the corpus from FILE (N-Quads) instead of\n"
+			"                       generating a synthetic one\n"
+			"  -r URI               Use URI as the Spindle root graph (default %s)\n"
+			"  -m PATH              Load spindle-generate from PATH\n"
+			"  -o SECTION:KEY=VALUE Set a configuration option\n"
+			"  -k                   Keep the temporary directory containing the cache\n"
+			"  -v                   Increase logging verbosity (may be repeated)\n",
+			progname, BENCH_COUNT, BENCH_ROOT);
+	return 0;
+}
+
+static int
+bench_config_set_(const char *key, const char *value)
+{
+	struct bench_config_struct *p;
+	size_t c;
+
+	for(c = 0; c < nconfig; c++)
+	{
+		if(!strcmp(config[c].key, key))
+		{
+			/* Options given on the command-line take precedence */
+			return 0;
+		}
+	}
+	p = (struct bench_config_struct *) realloc(config, sizeof(struct bench_config_struct) * (nconfig + 1));
+	if(!p)
+	{
+		return -1;
+	}
+	config = p;
+	config[nconfig].key = strdup(key);
+	config[nconfig].value = strdup(value);
+	nconfig++;
+	return 0;
+}
+
+/* Generate a synthetic corpus: each entity is described by its own source
+ * graph, and is co-referenced with a proxy in the root graph
+ */
+static int
+bench_corpus_generate_(librdf_model *model, const char *root, int count)
+{
+	static const char *classes[] = {
+		NS_FOAF "Person", "http://www.w3.org/2003/01/geo/wgs84_pos#SpatialThing",
+		"http://purl.org/vocab/frbr/core#Work", "http://www.w3.org/2004/02/skos/core#Concept"
+	};
+	struct bench_buf_struct buf;
+	char line[1024];
+	int i, r;
+
+	memset(&buf, 0, sizeof(buf));
+	for(i = 0; i < count; i++)
+	{
+		snprintf(line, sizeof(line),
+				 "<" BENCH_ROOT "things/%d#id> <" NS_RDF "type> <%s> <" BENCH_ROOT "graphs/%d> .\n"
+				 "<" BENCH_ROOT "things/%d#id> <" NS_RDFS "label> \"Thing %d\"@en <" BENCH_ROOT "graphs/%d> .\n"
+				 "<" BENCH_ROOT "things/%d#id> <" NS_DCTERMS "description> \"A synthetic entity, number %d\"@en <" BENCH_ROOT "graphs/%d> .\n"
+				 "<" BENCH_ROOT "things/%d#id> <" NS_DCTERMS "subject> <" BENCH_ROOT "things/%d#id> <" BENCH_ROOT "graphs/%d> .\n"
+				 "<" BENCH_ROOT "things/%d#id> <" NS_FOAF "page> <" BENCH_ROOT "pages/%d> <" BENCH_ROOT "graphs/%d> .\n"
+				 "<" BENCH_ROOT "graphs/%d> <" NS_RDF "type> <" NS_FOAF "Document> <" BENCH_ROOT "graphs/%d> .\n"
+				 "<" BENCH_ROOT "graphs/%d> <" NS_RDFS "label> \"Source graph %d\"@en <" BENCH_ROOT "graphs/%d> .\n"
+				 "<" BENCH_ROOT "graphs/%d> <" NS_DCTERMS "rights> <http://creativecommons.org/publicdomain/zero/1.0/> <" BENCH_ROOT "graphs/%d> .\n"
+				 "<" BENCH_ROOT "things/%d#id> <" NS_OWL "sameAs> <%s%08x%024x#id> <%s> .\n",
+				 i, classes[i % 4], i,
+				 i, i, i,
+				 i, i, i,
+				 i, (i * 7) % count, i,
+				 i, i, i,
+				 i, i,
+				 i, i, i,
+				 i, i,
+				 i, root, 0xbe4c40ffU, (unsigned int) i, root);
+		if(bench_buf_append_(&buf, line, strlen(line)))
+		{
+			free(buf.buf);
+			return -1;
+		}
+	}
+	r = twine_rdf_model_parse(model, "application/n-quads", buf.buf, buf.len);
+	free(buf.buf);
+	return r;
+}
+
+/* Load a recorded corpus from an N-Quads file */
+static int
+bench_corpus_load_(librdf_model *model, const char *path)
+{
+	FILE *f;
+	char *buf;
+	long size;
+	int r;
+
+	f = fopen(path, "rb");
+	if(!f)
+	{
+		fprintf(stderr, "spindle-bench: %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+	buf = (char *) malloc(size + 1);
+	if(!buf || fread(buf, 1, size, f) != (size_t) size)
+	{
+		fprintf(stderr, "spindle-bench: %s: failed to read corpus\n", path);
+		free(buf);
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	buf[size] = 0;
+	r = twine_rdf_model_parse(model, "application/n-quads", buf, size);
+	free(buf);
+	return r;
+}
+
+/* Obtain the sorted list of distinct proxies in the root graph */
+static char **
+bench_entities_(librdf_model *model, const char *root, int limit, size_t *count)
+{
+	librdf_node *context, *object;
+	librdf_statement *query;
+	librdf_stream *stream;
+	char **list, **p;
+	size_t n, size, c, d;
+
+	*count = 0;
+	context = twine_rdf_node_createuri(root);
+	query = librdf_new_statement(world);
+	librdf_statement_set_predicate(query, twine_rdf_node_createuri(NS_OWL "sameAs"));
+	stream = librdf_model_find_statements_in_context(model, query, context);
+	list = NULL;
+	n = 0;
+	size = 0;
+	for(; stream && !librdf_stream_end(stream); librdf_stream_next(stream))
+	{
+		object = librdf_statement_get_object(librdf_stream_get_object(stream));
+		if(!librdf_node_is_resource(object))
+		{
+			continue;
+		}
+		if(n + 1 > size)
+		{
+			p = (char **) realloc(list, sizeof(char *) * (size + 256));
+			if(!p)
+			{
+				break;
+			}
+			list = p;
+			size += 256;
+		}
+		list[n] = strdup((const char *) librdf_uri_as_string(librdf_node_get_uri(object)));
+		n++;
+	}
+	if(stream)
+	{
+		librdf_free_stream(stream);
+	}
+	librdf_free_statement(query);
+	librdf_free_node(context);
+	if(!n)
+	{
+		return list;
+	}
+	qsort(list, n, sizeof(char *), bench_compare_);
+	for(c = 1, d = 1; c < n; c++)
+	{
+		if(strcmp(list[c], list[d - 1]))
+		{
+			list[d] = list[c];
+			d++;
+		}
+		else
+		{
+			free(list[c]);
+		}
+	}
+	for(n = d; n > (size_t) limit; n--)
+	{
+		free(list[n - 1]);
+	}
+	*count = n;
+	return list;
+}
+
+/* Report throughput, per-stage timings and resource usage */
+static int
+bench_report_(const char *statspath, size_t entities, unsigned long failed, double elapsed)
+{
+	FILE *f;
+	char line[256], stage[32];
+	double sum;
+	unsigned long value, sparql, sql;
+	struct rusage ru;
+
+	printf("entities:      %lu (%lu failed)\n", (unsigned long) entities, failed);
+	printf("elapsed:       %.3fs\n", elapsed);
+	printf("throughput:    %.1f entities/sec\n", elapsed > 0 ? (double) entities / elapsed : 0.0);
+	f = fopen(statspath, "r");
+	if(!f)
+	{
+		fprintf(stderr, "spindle-bench: failed to open statistics file %s: %s\n", statspath, strerror(errno));
+	}
+	else
+	{
+		sparql = 0;
+		sql = 0;
+		printf("\n%-12s %10s %12s %12s\n", "stage", "count", "total (s)", "mean (ms)");
+		while(fgets(line, sizeof(line), f))
+		{
+			if(sscanf(line, "spindle_stage_seconds_sum{stage=\"%31[^\"]\"} %lf", stage, &sum) == 2)
+			{
+				/* The count follows the sum */
+				if(!fgets(line, sizeof(line), f) ||
+				   sscanf(line, "spindle_stage_seconds_count{stage=\"%*[^\"]\"} %lu", &value) != 1)
+				{
+					value = 0;
+				}
+				printf("%-12s %10lu %12.3f %12.3f\n", stage, value, sum, value ? sum * 1000.0 / (double) value : 0.0);
+			}
+			else
+			{
+				sscanf(line, "spindle_sparql_requests_total %lu", &sparql);
+				sscanf(line, "spindle_sql_queries_total %lu", &sql);
+			}
+		}
+		fclose(f);
+		printf("\nSPARQL requests: %lu (%.1f per entity)\n", sparql, entities ? (double) sparql / (double) entities : 0.0);
+		printf("SQL statements:  %lu\n", sql);
+		printf("SPARQL updates:  %lu (not applied)\n", updates);
+	}
+	if(!getrusage(RUSAGE_SELF, &ru))
+	{
+		printf("peak RSS:        %ld KiB\n", ru.ru_maxrss);
+	}
+	return 0;
+}
+
+static int
+bench_buf_append_(struct bench_buf_struct *buf, const char *str, size_t len)
+{
+	char *p;
+	size_t size;
+
+	if(buf->len + len + 1 > buf->size)
+	{
+		for(size = (buf->size ? buf->size : 4096); size < buf->len + len + 1; size *= 2);
+		p = (char *) realloc(buf->buf, size);
+		if(!p)
+		{
+			fprintf(stderr, "spindle-bench: failed to allocate %lu bytes\n", (unsigned long) size);
+			return -1;
+		}
+		buf->buf = p;
+		buf->size = size;
+	}
+	memcpy(&(buf->buf[buf->len]), str, len);
+	buf->len += len;
+	buf->buf[buf->len] = 0;
+	return 0;
+}
+
+/* Append a node to a query in SPARQL syntax */
+static int
+bench_buf_node_(struct bench_buf_struct *buf, librdf_node *node)
+{
+	const char *s, *lang;
+	librdf_uri *dt;
+	char tmp[8];
+
+	if(librdf_node_is_resource(node))
+	{
+		s = (const char *) librdf_uri_as_string(librdf_node_get_uri(node));
+		return (bench_buf_append_(buf, "<", 1) || bench_buf_append_(buf, s, strlen(s)) || bench_buf_append_(buf, ">", 1)) ? -1 : 0;
+	}
+	if(librdf_node_is_blank(node))
+	{
+		s = (const char *) librdf_node_get_blank_identifier(node);
+		return (bench_buf_append_(buf, "_:", 2) || bench_buf_append_(buf, s, strlen(s))) ? -1 : 0;
+	}
+	if(bench_buf_append_(buf, "\"", 1))
+	{
+		return -1;
+	}
+	for(s = (const char *) librdf_node_get_literal_value(node); *s; s++)
+	{
+		if(*s == '"' || *s == '\\' || *s == '\n' || *s == '\r')
+		{
+			tmp[0] = '\\';
+			tmp[1] = (*s == '\n' ? 'n' : (*s == '\r' ? 'r' : *s));
+			if(bench_buf_append_(buf, tmp, 2))
+			{
+				return -1;
+			}
+		}
+		else if(bench_buf_append_(buf, s, 1))
+		{
+			return -1;
+		}
+	}
+	if(bench_buf_append_(buf, "\"", 1))
+	{
+		return -1;
+	}
+	if((lang = librdf_node_get_literal_value_language(node)))
+	{
+		return (bench_buf_append_(buf, "@", 1) || bench_buf_append_(buf, lang, strlen(lang))) ? -1 : 0;
+	}
+	if((dt = librdf_node_get_literal_value_datatype_uri(node)))
+	{
+		s = (const char *) librdf_uri_as_string(dt);
+		return (bench_buf_append_(buf, "^^<", 3) || bench_buf_append_(buf, s, strlen(s)) || bench_buf_append_(buf, ">", 1)) ? -1 : 0;
+	}
+	return 0;
+}
+
+/* Expand a SPARQL query format string, as used by sparql_queryf_model() and
+ * sparql_updatef(): %V is a librdf_node, %s a string and %% a literal %
+ */
+static char *
+bench_vformat_(const char *format, va_list ap)
+{
+	struct bench_buf_struct buf;
+	const char *s, *p;
+
+	memset(&buf, 0, sizeof(buf));
+	for(s = format; *s; s = p)
+	{
+		for(p = s; *p && *p != '%'; p++);
+		if(p > s && bench_buf_append_(&buf, s, p - s))
+		{
+			free(buf.buf);
+			return NULL;
+		}
+		if(!*p)
+		{
+			break;
+		}
+		p++;
+		if(*p == 'V')
+		{
+			if(bench_buf_node_(&buf, va_arg(ap, librdf_node *)))
+			{
+				free(buf.buf);
+				return NULL;
+			}
+		}
+		else if(*p == 's')
+		{
+			s = va_arg(ap, const char *);
+			if(bench_buf_append_(&buf, s, strlen(s)))
+			{
+				free(buf.buf);
+				return NULL;
+			}
+		}
+		else if(bench_buf_append_(&buf, p, 1))
+		{
+			free(buf.buf);
+			return NULL;
+		}
+		p++;
+	}
+	if(!buf.buf)
+	{
+		return strdup("");
+	}
+	return buf.buf;
+}
+
+static librdf_query_results *
+bench_query_(SPARQL *sparql, const char *query, size_t length, librdf_query **queryp)
+{
+	librdf_query_results *results;
+	char *buf;
+
+	*queryp = NULL;
+	buf = (char *) malloc(length + 1);
+	if(!buf)
+	{
+		return NULL;
+	}
+	memcpy(buf, query, length);
+	buf[length] = 0;
+	if(loglevel >= LOG_DEBUG)
+	{
+		fprintf(stderr, "SPARQL: %s\n", buf);
+	}
+	*queryp = librdf_new_query(world, "sparql", NULL, (const unsigned char *) buf, NULL);
+	free(buf);
+	if(!*queryp)
+	{
+		fprintf(stderr, "spindle-bench: failed to parse SPARQL query\n");
+		return NULL;
+	}
+	results = librdf_model_query_execute(sparql->model, *queryp);
+	if(!results)
+	{
+		fprintf(stderr, "spindle-bench: failed to execute SPARQL query\n");
+		librdf_free_query(*queryp);
+		*queryp = NULL;
+	}
+	return results;
+}
+
+static int
+bench_rmtree_(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	(void) sb;
+	(void) flag;
+	(void) ftw;
+
+	return remove(path);
+}
+
+static int
+bench_compare_(const void *a, const void *b)
+{
+	return strcmp(*((char *const *) a), *((char *const *) b));
+}
+
+/* Twine API */
+
+int
+twine_logf(int level, const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	twine_vlogf(level, format, ap);
+	va_end(ap);
+	return 0;
+}
+
+void
+twine_vlogf(int level, const char *format, va_list ap)
+{
+	if(level <= loglevel)
+	{
+		vfprintf(stderr, format, ap);
+	}
+}
+
+char *
+twine_config_geta(const char *key, const char *defval)
+{
+	size_t c;
+
+	for(c = 0; c < nconfig; c++)
+	{
+		if(!strcmp(config[c].key, key))
+		{
+			return strdup(config[c].value);
+		}
+	}
+	return defval ? strdup(defval) : NULL;
+}
+
+int
+twine_config_get_bool(const char *key, int defval)
+{
+	char *value;
+	int r;
+
+	value = twine_config_geta(key, NULL);
+	if(!value)
+	{
+		return defval;
+	}
+	r = (!strcmp(value, "1") || !strcasecmp(value, "yes") || !strcasecmp(value, "true") || !strcasecmp(value, "on"));
+	free(value);
+	return r;
+}
+
+long
+twine_config_get_int(const char *key, long defval)
+{
+	char *value;
+	long r;
+
+	value = twine_config_geta(key, NULL);
+	if(!value)
+	{
+		return defval;
+	}
+	r = strtol(value, NULL, 10);
+	free(value);
+	return r;
+}
+
+int
+twine_config_get_all(const char *section, const char *key, int (*fn)(const char *key, const char *value, void *data), void *data)
+{
+	size_t c;
+
+	(void) section;
+	(void) key;
+
+	for(c = 0; c < nconfig; c++)
+	{
+		if(fn(config[c].key, config[c].value, data))
+		{
+			break;
+		}
+	}
+	return 0;
+}
+
+librdf_world *
+twine_rdf_world(void)
+{
+	return world;
+}
+
+int
+twine_graph_register(const char *name, TWINE_GRAPH_PROCESSOR fn, void *data)
+{
+	(void) name;
+	(void) fn;
+	(void) data;
+
+	return 0;
+}
+
+int
+twine_postproc_register(const char *name, TWINE_GRAPH_PROCESSOR fn, void *data)
+{
+	(void) name;
+	(void) fn;
+	(void) data;
+
+	return 0;
+}
+
+int
+twine_update_register(const char *name, int (*fn)(const char *name, const char *identifier, void *data), void *data)
+{
+	if(!strcmp(name, "spindle"))
+	{
+		update_fn = fn;
+		update_data = data;
+	}
+	return 0;
+}
+
+int
+twine_plugin_register(const char *mimetype, const char *description, int (*fn)(const char *mime, const unsigned char *buf, size_t buflen, void *data), void *data)
+{
+	(void) mimetype;
+	(void) description;
+	(void) fn;
+	(void) data;
+
+	return 0;
+}
+
+librdf_model *
+twine_rdf_model_create(void)
+{
+	librdf_storage *storage;
+
+	storage = librdf_new_storage(world, "hashes", NULL, "hash-type='memory',contexts='yes'");
+	if(!storage)
+	{
+		return NULL;
+	}
+	return librdf_new_model(world, storage, NULL);
+}
+
+int
+twine_rdf_model_destroy(librdf_model *model)
+{
+	librdf_storage *storage;
+
+	storage = librdf_model_get_storage(model);
+	librdf_free_model(model);
+	if(storage)
+	{
+		librdf_free_storage(storage);
+	}
+	return 0;
+}
+
+int
+twine_rdf_model_add_st(librdf_model *model, librdf_statement *statement, librdf_node *ctx)
+{
+	if(ctx)
+	{
+		return librdf_model_context_add_statement(model, ctx, statement);
+	}
+	return librdf_model_add_statement(model, statement);
+}
+
+static char *
+bench_serialize_(librdf_model *model, const char *name, size_t *buflen)
+{
+	librdf_serializer *serializer;
+	unsigned char *buf;
+
+	serializer = librdf_new_serializer(world, name, NULL, NULL);
+	if(!serializer)
+	{
+		return NULL;
+	}
+	buf = librdf_serializer_serialize_model_to_counted_string(serializer, NULL, model, buflen);
+	librdf_free_serializer(serializer);
+	return (char *) buf;
+}
+
+char *
+twine_rdf_model_nquads(librdf_model *model, size_t *buflen)
+{
+	return bench_serialize_(model, "nquads", buflen);
+}
+
+char *
+twine_rdf_model_ntriples(librdf_model *model, size_t *buflen)
+{
+	return bench_serialize_(model, "ntriples", buflen);
+}
+
+int
+twine_rdf_model_parse(librdf_model *model, const char *mime, const char *buf, size_t buflen)
+{
+	librdf_parser *parser;
+	librdf_uri *base;
+	int r;
+
+	parser = librdf_new_parser(world, NULL, mime, NULL);
+	if(!parser)
+	{
+		fprintf(stderr, "spindle-bench: no parser available for %s\n", mime);
+		return -1;
+	}
+	base = librdf_new_uri(world, (const unsigned char *) BENCH_ROOT);
+	r = librdf_parser_parse_counted_string_into_model(parser, (const unsigned char *) buf, buflen, base, model);
+	librdf_free_uri(base);
+	librdf_free_parser(parser);
+	return r ? -1 : 0;
+}
+
+librdf_node *
+twine_rdf_node_clone(librdf_node *node)
+{
+	return librdf_new_node_from_node(node);
+}
+
+librdf_node *
+twine_rdf_node_createuri(const char *uri)
+{
+	return librdf_new_node_from_uri_string(world, (const unsigned char *) uri);
+}
+
+int
+twine_rdf_node_destroy(librdf_node *node)
+{
+	librdf_free_node(node);
+	return 0;
+}
+
+int
+twine_rdf_node_intval(librdf_node *node, long *value)
+{
+	const char *s;
+	char *end;
+
+	if(!node || !librdf_node_is_literal(node))
+	{
+		return 0;
+	}
+	s = (const char *) librdf_node_get_literal_value(node);
+	*value = strtol(s, &end, 10);
+	return (end > s && !*end) ? 1 : 0;
+}
+
+librdf_statement *
+twine_rdf_st_clone(librdf_statement *statement)
+{
+	return librdf_new_statement_from_statement(statement);
+}
+
+librdf_statement *
+twine_rdf_st_create(void)
+{
+	return librdf_new_statement(world);
+}
+
+int
+twine_rdf_st_destroy(librdf_statement *statement)
+{
+	librdf_free_statement(statement);
+	return 0;
+}
+
+int
+twine_rdf_st_obj_intval(librdf_statement *statement, long *value)
+{
+	return twine_rdf_node_intval(librdf_statement_get_object(statement), value);
+}
+
+SPARQL *
+twine_sparql_create(void)
+{
+	SPARQL *sparql;
+
+	sparql = (SPARQL *) calloc(1, sizeof(SPARQL));
+	if(sparql)
+	{
+		sparql->model = store;
+	}
+	return sparql;
+}
+
+/* SPARQL client API, evaluated against the in-memory store */
+
+int
+sparql_destroy(SPARQL *sparql)
+{
+	free(sparql);
+	return 0;
+}
+
+SPARQLRES *
+sparql_query(SPARQL *sparql, const char *query, size_t length)
+{
+	SPARQLRES *res;
+
+	res = (SPARQLRES *) calloc(1, sizeof(SPARQLRES));
+	if(!res)
+	{
+		return NULL;
+	}
+	res->results = bench_query_(sparql, query, length, &(res->query));
+	if(!res->results)
+	{
+		free(res);
+		return NULL;
+	}
+	res->row.count = librdf_query_results_get_bindings_count(res->results);
+	res->row.nodes = (librdf_node **) calloc(res->row.count + 1, sizeof(librdf_node *));
+	return res;
+}
+
+static void
+bench_row_clear_(SPARQLRES *res)
+{
+	int c;
+
+	for(c = 0; c < res->row.count; c++)
+	{
+		if(res->row.nodes[c])
+		{
+			librdf_free_node(res->row.nodes[c]);
+			res->row.nodes[c] = NULL;
+		}
+	}
+}
+
+SPARQLROW *
+sparqlres_next(SPARQLRES *res)
+{
+	int c;
+
+	bench_row_clear_(res);
+	if(res->started)
+	{
+		librdf_query_results_next(res->results);
+	}
+	res->started = 1;
+	if(librdf_query_results_finished(res->results))
+	{
+		return NULL;
+	}
+	for(c = 0; c < res->row.count; c++)
+	{
+		res->row.nodes[c] = librdf_query_results_get_binding_value(res->results, c);
+	}
+	return &(res->row);
+}
+
+librdf_node *
+sparqlrow_binding(SPARQLROW *row, unsigned int index)
+{
+	if(index >= (unsigned int) row->count)
+	{
+		return NULL;
+	}
+	return row->nodes[index];
+}
+
+int
+sparqlres_destroy(SPARQLRES *res)
+{
+	bench_row_clear_(res);
+	free(res->row.nodes);
+	librdf_free_query_results(res->results);
+	librdf_free_query(res->query);
+	free(res);
+	return 0;
+}
+
+/* Add the results of a query to a model: graph results are added as-is,
+ * while the ?s ?p ?o (and optionally ?g) bindings of a SELECT become
+ * statements (in context ?g)
+ */
+int
+sparql_query_model(SPARQL *sparql, const char *query, size_t length, librdf_model *model)
+{
+	librdf_query *q;
+	librdf_query_results *results;
+	librdf_stream *stream;
+	librdf_statement *st;
+	librdf_node *s, *p, *o, *g;
+
+	results = bench_query_(sparql, query, length, &q);
+	if(!results)
+	{
+		return -1;
+	}
+	if(librdf_query_results_is_graph(results))
+	{
+		stream = librdf_query_results_as_stream(results);
+		if(stream)
+		{
+			librdf_model_add_statements(model, stream);
+			librdf_free_stream(stream);
+		}
+	}
+	else
+	{
+		for(; !librdf_query_results_finished(results); librdf_query_results_next(results))
+		{
+			s = librdf_query_results_get_binding_value_by_name(results, "s");
+			p = librdf_query_results_get_binding_value_by_name(results, "p");
+			o = librdf_query_results_get_binding_value_by_name(results, "o");
+			g = librdf_query_results_get_binding_value_by_name(results, "g");
+			if(s && p && o)
+			{
+				/* The statement takes ownership of s, p and o (freeing them
+				 * itself if it can't be created), but the context node
+				 * remains ours
+				 */
+				st = librdf_new_statement_from_nodes(world, s, p, o);
+				if(st)
+				{
+					twine_rdf_model_add_st(model, st, g);
+					librdf_free_statement(st);
+				}
+				if(g)
+				{
+					librdf_free_node(g);
+				}
+				continue;
+			}
+			if(s) librdf_free_node(s);
+			if(p) librdf_free_node(p);
+			if(o) librdf_free_node(o);
+			if(g) librdf_free_node(g);
+		}
+	}
+	librdf_free_query_results(results);
+	librdf_free_query(q);
+	return 0;
+}
+
+int
+sparql_queryf_model(SPARQL *sparql, librdf_model *model, const char *format, ...)
+{
+	va_list ap;
+	char *query;
+	int r;
+
+	va_start(ap, format);
+	query = bench_vformat_(format, ap);
+	va_end(ap);
+	if(!query)
+	{
+		return -1;
+	}
+	r = sparql_query_model(sparql, query, strlen(query), model);
+	free(query);
+	return r;
+}
+
+/* librdf can't evaluate SPARQL Update, so updates are counted but not
+ * applied; generation only writes to the store, so this doesn't affect the
+ * work being measured
+ */
+int
+sparql_update(SPARQL *sparql, const char *statement, size_t length)
+{
+	(void) sparql;
+	(void) statement;
+	(void) length;
+
+	updates++;
+	return 0;
+}
+
+int
+sparql_updatef(SPARQL *sparql, const char *format, ...)
+{
+	(void) sparql;
+	(void) format;
+
+	updates++;
+	return 0;
+}
+
+/* Replace the contents of a graph */
+int
+sparql_put(SPARQL *sparql, const char *graph, const char *data, size_t length)
+{
+	librdf_model *temp;
+	librdf_stream *stream;
+	librdf_node *context;
+
+	temp = twine_rdf_model_create();
+	if(!temp)
+	{
+		return -1;
+	}
+	if(twine_rdf_model_parse(temp, "application/n-triples", data, length))
+	{
+		twine_rdf_model_destroy(temp);
+		return -1;
+	}
+	context = twine_rdf_node_createuri(graph);
+	librdf_model_context_remove_statements(sparql->model, context);
+	stream = librdf_model_as_stream(temp);
+	librdf_model_context_add_statements(sparql->model, context, stream);
+	librdf_free_stream(stream);
+	librdf_free_node(context);
+	twine_rdf_model_destroy(temp);
+	return 0;
+}
+
+/* Add the statements in a model, with their contexts, to the store */
+int
+sparql_insert_model(SPARQL *sparql, librdf_model *model)
+{
+	librdf_stream *stream;
+
+	stream = librdf_model_as_stream(model);
+	for(; stream && !librdf_stream_end(stream); librdf_stream_next(stream))
+	{
+		twine_rdf_model_add_st(sparql->model, librdf_stream_get_object(stream), librdf_stream_get_context2(stream));
+	}
+	if(stream)
+	{
+		librdf_free_stream(stream);
+	}
+	return 0;
+}
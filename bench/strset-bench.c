@@ -0,0 +1,293 @@
+/* Spindle: Co-reference aggregation engine
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* strset-bench: a micro-benchmark of the string-set
+ *
+ * For each set size, a string-set is filled with that many distinct URIs,
+ * each of which is added twice (as happens when the same source is seen
+ * through several co-references), and then each is looked up. The mean time
+ * per operation is reported, together with that of a reference linear set
+ * which behaves as the string-set did before it was indexed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "spindle-common.h"
+
+#define BENCH_ROUNDS_MIN                3
+
+struct bench_linear_struct
+{
+	char **strings;
+	size_t count;
+	size_t size;
+};
+
+static int bench_usage_(const char *progname);
+static int bench_run_(size_t n, char **uris);
+static int bench_linear_add_(struct bench_linear_struct *set, const char *str);
+static int bench_linear_contains_(struct bench_linear_struct *set, const char *str);
+static void bench_linear_destroy_(struct bench_linear_struct *set);
+static double bench_clock_(void);
+
+static size_t sizes[] = { 10, 1000, 100000 };
+static int linear = 1;
+
+int
+main(int argc, char **argv)
+{
+	size_t c, n, max;
+	char **uris;
+	int ch;
+
+	while((ch = getopt(argc, argv, "hl")) != -1)
+	{
+		switch(ch)
+		{
+		case 'h':
+			bench_usage_(argv[0]);
+			return 0;
+		case 'l':
+			linear = 0;
+			break;
+		default:
+			bench_usage_(argv[0]);
+			return 1;
+		}
+	}
+	if(optind != argc)
+	{
+		bench_usage_(argv[0]);
+		return 1;
+	}
+	max = 0;
+	for(c = 0; c < sizeof(sizes) / sizeof(sizes[0]); c++)
+	{
+		if(sizes[c] > max)
+		{
+			max = sizes[c];
+		}
+	}
+	uris = (char **) calloc(max, sizeof(char *));
+	if(!uris)
+	{
+		fprintf(stderr, "%s: failed to allocate memory\n", argv[0]);
+		return 1;
+	}
+	for(n = 0; n < max; n++)
+	{
+		uris[n] = (char *) malloc(64);
+		if(!uris[n])
+		{
+			fprintf(stderr, "%s: failed to allocate memory\n", argv[0]);
+			return 1;
+		}
+		snprintf(uris[n], 64, "http://bench.invalid/things/%08lx#id", (unsigned long) (n * 2654435761UL));
+	}
+	printf("%-10s %-10s %14s %14s\n", "entries", "set", "ns/add", "ns/lookup");
+	for(c = 0; c < sizeof(sizes) / sizeof(sizes[0]); c++)
+	{
+		if(bench_run_(sizes[c], uris))
+		{
+			fprintf(stderr, "%s: benchmark failed\n", argv[0]);
+			return 1;
+		}
+	}
+	for(n = 0; n < max; n++)
+	{
+		free(uris[n]);
+	}
+	free(uris);
+	return 0;
+}
+
+static int
+bench_usage_(const char *progname)
+{
+	fprintf(stderr, "Usage: %s [OPTIONS]\n"
+			"\n"
+			"OPTIONS is one or more of:\n"
+			"  -h                   Print this notice and exit\n"
+			"  -l                   Skip the reference linear set\n",
+			progname);
+	return 0;
+}
+
+/* Measure both kinds of set at a single size; smaller sets are filled
+ * repeatedly, so that each measurement covers a similar number of operations
+ */
+static int
+bench_run_(size_t n, char **uris)
+{
+	struct spindle_strset_struct *set;
+	struct bench_linear_struct lset;
+	size_t c, r, rounds;
+	double start, add, lookup;
+	int found;
+
+	rounds = 100000 / n;
+	if(rounds < BENCH_ROUNDS_MIN)
+	{
+		rounds = BENCH_ROUNDS_MIN;
+	}
+	add = lookup = 0;
+	found = 0;
+	for(r = 0; r < rounds; r++)
+	{
+		set = spindle_strset_create();
+		if(!set)
+		{
+			return -1;
+		}
+		start = bench_clock_();
+		for(c = 0; c < n * 2; c++)
+		{
+			if(spindle_strset_add(set, uris[c % n]))
+			{
+				spindle_strset_destroy(set);
+				return -1;
+			}
+		}
+		add += bench_clock_() - start;
+		start = bench_clock_();
+		for(c = 0; c < n; c++)
+		{
+			found += spindle_strset_contains(set, uris[c]);
+		}
+		lookup += bench_clock_() - start;
+		spindle_strset_destroy(set);
+	}
+	printf("%-10lu %-10s %14.1f %14.1f\n", (unsigned long) n, "strset",
+		   add / (double) (rounds * n * 2), lookup / (double) (rounds * n));
+	if(found != (int) (rounds * n))
+	{
+		return -1;
+	}
+	if(!linear)
+	{
+		return 0;
+	}
+	/* The reference set is much slower at large sizes; one round will do */
+	if(n > 1000)
+	{
+		rounds = 1;
+	}
+	add = lookup = 0;
+	found = 0;
+	for(r = 0; r < rounds; r++)
+	{
+		memset(&lset, 0, sizeof(lset));
+		start = bench_clock_();
+		for(c = 0; c < n * 2; c++)
+		{
+			if(bench_linear_add_(&lset, uris[c % n]))
+			{
+				bench_linear_destroy_(&lset);
+				return -1;
+			}
+		}
+		add += bench_clock_() - start;
+		start = bench_clock_();
+		for(c = 0; c < n; c++)
+		{
+			found += bench_linear_contains_(&lset, uris[c]);
+		}
+		lookup += bench_clock_() - start;
+		bench_linear_destroy_(&lset);
+	}
+	printf("%-10lu %-10s %14.1f %14.1f\n", (unsigned long) n, "linear",
+		   add / (double) (rounds * n * 2), lookup / (double) (rounds * n));
+	return (found == (int) (rounds * n) ? 0 : -1);
+}
+
+/* Add a string to the reference set: a linear scan, then strdup(), growing
+ * the array four entries at a time
+ */
+static int
+bench_linear_add_(struct bench_linear_struct *set, const char *str)
+{
+	char **p;
+
+	if(bench_linear_contains_(set, str))
+	{
+		return 0;
+	}
+	if(set->count + 1 > set->size)
+	{
+		p = (char **) realloc(set->strings, sizeof(char *) * (set->size + 4));
+		if(!p)
+		{
+			return -1;
+		}
+		set->strings = p;
+		set->size += 4;
+	}
+	set->strings[set->count] = strdup(str);
+	if(!set->strings[set->count])
+	{
+		return -1;
+	}
+	set->count++;
+	return 0;
+}
+
+static int
+bench_linear_contains_(struct bench_linear_struct *set, const char *str)
+{
+	size_t c;
+
+	for(c = 0; c < set->count; c++)
+	{
+		if(!strcmp(set->strings[c], str))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void
+bench_linear_destroy_(struct bench_linear_struct *set)
+{
+	size_t c;
+
+	for(c = 0; c < set->count; c++)
+	{
+		free(set->strings[c]);
+	}
+	free(set->strings);
+}
+
+/* Return a monotonic time in nanoseconds */
+static double
+bench_clock_(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1000000000.0 + (double) ts.tv_nsec;
+}
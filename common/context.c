@@ -33,6 +33,11 @@ spindle_init(SPINDLE *spindle)
 		return -1;
 	}
 	spindle->multigraph = twine_config_get_bool("spindle:multigraph", 0);
+	spindle->debounce = twine_config_get_int("spindle:debounce", 2);
+	if(spindle->debounce < 0)
+	{
+		spindle->debounce = 0;
+	}
 	spindle->root = twine_config_geta("spindle:graph", NULL);
 	if(!spindle->root)
 	{
@@ -74,10 +79,16 @@ spindle_init(SPINDLE *spindle)
 		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to create URI for xsd:dateTime\n");
 		return -1;
 	}
-	spindle->graphcache = (struct spindle_graphcache_struct *) calloc(SPINDLE_GRAPHCACHE_SIZE, sizeof(struct spindle_graphcache_struct));
-	if(!spindle->graphcache)
+	if(spindle_graphcache_init(spindle))
+	{
+		return -1;
+	}
+	if(spindle_diskcache_init(spindle))
+	{
+		return -1;
+	}
+	if(spindle_stats_init(spindle))
 	{
-		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to create graph cache\n");
 		return -1;
 	}
 	return 0;
@@ -86,8 +97,6 @@ spindle_init(SPINDLE *spindle)
 int
 spindle_cleanup(SPINDLE *spindle)
 {
-	size_t c;
-	
 	if(spindle->sparql)
 	{
 		sparql_destroy(spindle->sparql);
@@ -120,19 +129,10 @@ spindle_cleanup(SPINDLE *spindle)
 	{
 		spindle_rulebase_destroy(spindle->rules);
 	}
-	if(spindle->graphcache)
-	{
-		for(c = 0; spindle->graphcache && c < SPINDLE_GRAPHCACHE_SIZE; c++)
-		{
-			if(!spindle->graphcache[c].uri)
-			{
-				continue;
-			}
-			twine_rdf_model_destroy(spindle->graphcache[c].model);
-			free(spindle->graphcache[c].uri);
-		}
-		free(spindle->graphcache);
-	}
+	spindle_graphcache_cleanup(spindle);
+	spindle_diskcache_cleanup(spindle);
+	spindle_proxycache_cleanup(spindle);
+	spindle_stats_cleanup(spindle);
 	spindle_db_cleanup(spindle);
 	return 0;
 }
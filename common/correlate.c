@@ -26,6 +26,12 @@
 /* 36 characters plus trailing NUL byte */
 #define UUID_BUFFER_SIZE                37
 
+/* The maximum number of URIs looked up by a single SPARQL query */
+#define LOCATE_BATCH_SIZE               64
+
+static int spindle_proxy_locate_compare_(const void *a, const void *b);
+static int spindle_proxy_locate_sparql_(SPINDLE *spindle, struct spindle_locate_struct *list, size_t count);
+
 /* Generate a new local URI for an external URI */
 char *
 spindle_proxy_generate(SPINDLE *spindle, const char *uri)
@@ -86,6 +92,10 @@ spindle_proxy_locate(SPINDLE *spindle, const char *uri)
 	/* TODO: if uri is within our namespace and is valid, return it as-is */
 	errno = 0;
 	localname = NULL;
+	if(spindle_proxycache_get(spindle, uri, &localname))
+	{
+		return localname;
+	}
 	l = strlen(uri) + strlen(spindle->root) + 127;
 	if(!l)
 	{
@@ -93,6 +103,7 @@ spindle_proxy_locate(SPINDLE *spindle, const char *uri)
 	}
 	qbuf = (char *) calloc(1, l + 1);
 	snprintf(qbuf, l, "SELECT DISTINCT ?o FROM <%s> WHERE { <%s> <" NS_OWL "sameAs> ?o . }", spindle->root, uri);
+	spindle_stats_sparql(spindle, strlen(qbuf));
 	res = sparql_query(spindle->sparql, qbuf, strlen(qbuf));
 	if(!res)
 	{
@@ -114,13 +125,199 @@ spindle_proxy_locate(SPINDLE *spindle, const char *uri)
 			if(!localname)
 			{
 				twine_logf(LOG_ERR, PLUGIN_NAME ": failed to duplicate URI string\n");
+				sparqlres_destroy(res);
+				return NULL;
 			}
 		}
 	}
 	sparqlres_destroy(res);
+	spindle_proxycache_set(spindle, uri, localname);
 	return localname;
 }
 
+/* Look up the local URIs for a list of external URIs */
+int
+spindle_proxy_locate_many(SPINDLE *spindle, const char **uris, size_t count, char **localnames)
+{
+	struct spindle_locate_struct *list;
+	size_t c, n;
+	int r, hit;
+
+	if(!count)
+	{
+		return 0;
+	}
+	list = (struct spindle_locate_struct *) calloc(count, sizeof(struct spindle_locate_struct));
+	if(!list)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate proxy lookup list\n");
+		return -1;
+	}
+	for(c = 0, n = 0; c < count; c++)
+	{
+		localnames[c] = NULL;
+		if(!spindle->db)
+		{
+			hit = spindle_proxycache_get(spindle, uris[c], &(localnames[c]));
+			if(hit < 0)
+			{
+				free(list);
+				return -1;
+			}
+			if(hit)
+			{
+				continue;
+			}
+		}
+		list[n].uri = uris[c];
+		list[n].dest = &(localnames[c]);
+		n++;
+	}
+	r = 0;
+	if(n)
+	{
+		qsort(list, n, sizeof(struct spindle_locate_struct), spindle_proxy_locate_compare_);
+		if(spindle->db)
+		{
+			r = spindle_db_proxy_locate_many(spindle, list, n);
+		}
+		else
+		{
+			r = spindle_proxy_locate_sparql_(spindle, list, n);
+		}
+	}
+	free(list);
+	if(r)
+	{
+		for(c = 0; c < count; c++)
+		{
+			free(localnames[c]);
+			localnames[c] = NULL;
+		}
+		return -1;
+	}
+	return 0;
+}
+
+/* Record the proxy found for a URI within a sorted batch, which may contain
+ * the same URI more than once
+ */
+int
+spindle_proxy_locate_found(struct spindle_locate_struct *list, size_t count, const char *uri, const char *localname)
+{
+	struct spindle_locate_struct key, *p, *end;
+
+	if(!uri || !localname)
+	{
+		return 0;
+	}
+	key.uri = uri;
+	p = (struct spindle_locate_struct *) bsearch(&key, list, count, sizeof(struct spindle_locate_struct), spindle_proxy_locate_compare_);
+	if(!p)
+	{
+		return 0;
+	}
+	while(p > list && !strcmp(p[-1].uri, uri))
+	{
+		p--;
+	}
+	for(end = list + count; p < end && !strcmp(p->uri, uri); p++)
+	{
+		if(*(p->dest))
+		{
+			continue;
+		}
+		*(p->dest) = strdup(localname);
+		if(!*(p->dest))
+		{
+			twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to duplicate URI string\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+spindle_proxy_locate_compare_(const void *a, const void *b)
+{
+	return strcmp(((const struct spindle_locate_struct *) a)->uri, ((const struct spindle_locate_struct *) b)->uri);
+}
+
+/* Look up a sorted batch of URIs using a VALUES block per chunk of
+ * LOCATE_BATCH_SIZE, caching the results (including URIs with no proxy)
+ */
+static int
+spindle_proxy_locate_sparql_(SPINDLE *spindle, struct spindle_locate_struct *list, size_t count)
+{
+	SPARQLRES *res;
+	SPARQLROW *row;
+	librdf_node *snode, *onode;
+	librdf_uri *ruri;
+	const char *sstr, *ostr;
+	char *qbuf, *qp;
+	size_t base, end, c, l;
+	int r;
+
+	r = 0;
+	for(base = 0; !r && base < count; base = end)
+	{
+		end = base + LOCATE_BATCH_SIZE;
+		if(end > count)
+		{
+			end = count;
+		}
+		l = strlen(spindle->root) + 160;
+		for(c = base; c < end; c++)
+		{
+			l += strlen(list[c].uri) + 3;
+		}
+		qbuf = (char *) calloc(1, l + 1);
+		if(!qbuf)
+		{
+			twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate SPARQL query buffer\n");
+			return -1;
+		}
+		qp = qbuf;
+		qp += sprintf(qp, "SELECT DISTINCT ?s ?o FROM <%s> WHERE { VALUES ?s {", spindle->root);
+		for(c = base; c < end; c++)
+		{
+			if(c > base && !strcmp(list[c].uri, list[c - 1].uri))
+			{
+				continue;
+			}
+			qp += sprintf(qp, " <%s>", list[c].uri);
+		}
+		sprintf(qp, " } ?s <" NS_OWL "sameAs> ?o . }");
+		spindle_stats_sparql(spindle, strlen(qbuf));
+		res = sparql_query(spindle->sparql, qbuf, strlen(qbuf));
+		free(qbuf);
+		if(!res)
+		{
+			twine_logf(LOG_ERR, PLUGIN_NAME ": failed to query for the proxies of %lu URIs in <%s>\n", (unsigned long) (end - base), spindle->root);
+			return -1;
+		}
+		while(!r && (row = sparqlres_next(res)))
+		{
+			snode = sparqlrow_binding(row, 0);
+			onode = sparqlrow_binding(row, 1);
+			if(!snode || !onode ||
+			   !librdf_node_is_resource(snode) || !librdf_node_is_resource(onode) ||
+			   !(ruri = librdf_node_get_uri(snode)) || !(sstr = (const char *) librdf_uri_as_string(ruri)) ||
+			   !(ruri = librdf_node_get_uri(onode)) || !(ostr = (const char *) librdf_uri_as_string(ruri)))
+			{
+				continue;
+			}
+			r = spindle_proxy_locate_found(list + base, end - base, sstr, ostr);
+		}
+		sparqlres_destroy(res);
+		for(c = base; !r && c < end; c++)
+		{
+			spindle_proxycache_set(spindle, list[c].uri, *(list[c].dest));
+		}
+	}
+	return r;
+}
+
 /* Assert that two URIs are equivalent */
 int
 spindle_proxy_create(SPINDLE *spindle, const char *uri1, const char *uri2, struct spindle_strset_struct *changeset)
@@ -281,6 +478,26 @@ spindle_proxy_create(SPINDLE *spindle, const char *uri1, const char *uri2, struc
 	return 0;
 }
 
+/* Assert all of the equivalences in a co-reference set */
+int
+spindle_proxy_create_set(SPINDLE *spindle, struct spindle_corefset_struct *corefs, struct spindle_strset_struct *changeset)
+{
+	size_t c;
+
+	if(spindle->db)
+	{
+		return spindle_db_proxy_create_set(spindle, corefs, changeset);
+	}
+	for(c = 0; c < corefs->refcount; c++)
+	{
+		if(spindle_proxy_create(spindle, corefs->refs[c].left, corefs->refs[c].right, changeset))
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
 /* Move a set of references from one proxy to another */
 int
 spindle_proxy_migrate(SPINDLE *spindle, const char *from, const char *to, char **refs)
@@ -340,6 +557,7 @@ spindle_proxy_migrate(SPINDLE *spindle, const char *from, const char *to, char *
 		qp += sprintf(qp, "<%s> owl:sameAs <%s> .\n", refs[c], to);
 	}
 	qp += sprintf(qp, "} }");
+	spindle_stats_sparql(spindle, strlen(qbuf));
 	sparql_update(spindle->sparql, qbuf, strlen(qbuf));
 	/* Generate a DELETE DATA for the old references */
 	qp = qbuf;
@@ -351,8 +569,11 @@ spindle_proxy_migrate(SPINDLE *spindle, const char *from, const char *to, char *
 		qp += sprintf(qp, "<%s> owl:sameAs <%s> .\n", refs[c], from);
 	}
 	qp += sprintf(qp, "} }");
+	spindle_stats_sparql(spindle, strlen(qbuf));
 	sparql_update(spindle->sparql, qbuf, strlen(qbuf));
 	free(qbuf);
+	/* The references now belong to the new proxy */
+	spindle_proxycache_move(spindle, from, to);
 	if(allocated)
 	{
 		spindle_proxy_refs_destroy(refs);
@@ -389,6 +610,7 @@ spindle_proxy_refs(SPINDLE *spindle, const char *uri)
 		return NULL;
 	}
 	snprintf(qbuf, l, "SELECT DISTINCT ?s FROM <%s> WHERE { ?s <" NS_OWL "sameAs> <%s> . }", spindle->root, uri);
+	spindle_stats_sparql(spindle, strlen(qbuf));
 	res = sparql_query(spindle->sparql, qbuf, strlen(qbuf));
 	if(!res)
 	{
@@ -476,6 +698,7 @@ spindle_proxy_relate(SPINDLE *spindle, const char *remote, const char *local)
 	}
 	snprintf(qbuf, l, "PREFIX owl: <" NS_OWL ">\nINSERT DATA {\nGRAPH <%s> {\n<%s> owl:sameAs <%s> . } }", spindle->root, remote, local);
 	twine_logf(LOG_DEBUG, "%s\n", qbuf);
+	spindle_stats_sparql(spindle, strlen(qbuf));
 	r = sparql_update(spindle->sparql, qbuf, strlen(qbuf));
 	free(qbuf);
 	if(r)
@@ -484,5 +707,6 @@ spindle_proxy_relate(SPINDLE *spindle, const char *remote, const char *local)
 		return -1;
 	}
 	twine_logf(LOG_DEBUG, PLUGIN_NAME ": INSERT succeeded\n");
+	spindle_proxycache_set(spindle, remote, local);
 	return 0;
 }
@@ -26,29 +26,40 @@
 static int spindle_db_querylog_(SQL *restrict sql, const char *query);
 static int spindle_db_noticelog_(SQL *restrict sql, const char *notice);
 static int spindle_db_errorlog_(SQL *restrict sql, const char *sqlstate, const char *message);
+static int spindle_db_perform_(SQL *restrict sql, void *restrict userdata);
+static int spindle_db_connect_(SPINDLE *spindle);
+static int spindle_db_seq_compare_(const void *a, const void *b);
+
+/* A transaction being performed by spindle_db_perform() */
+struct spindle_db_perform_struct
+{
+	SPINDLE *spindle;
+	SQL_PERFORM_TXN fn;
+	void *data;
+};
+
+/* The context which owns the database connection; libsql doesn't pass any
+ * user data to its logging callbacks
+ */
+static SPINDLE *db_spindle;
 
 /* Initialise a Spindle database connection, if configured to use one */
 int
 spindle_db_init(SPINDLE *spindle)
 {
-	char *t;
-
-	t = twine_config_geta("spindle:db", NULL);
-	if(!t)
+	if(spindle_db_connect_(spindle))
 	{
-		return 0;
+		return -1;
 	}
-	spindle->db = sql_connect(t);
 	if(!spindle->db)
 	{
-		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to connect to database <%s>\n", t);
-		free(t);
+		/* Without a database, proxy lookups are SPARQL queries */
+		return spindle_proxycache_init(spindle);
+	}
+	if(spindle_querystats_init(spindle))
+	{
 		return -1;
 	}
-	free(t);
-	sql_set_querylog(spindle->db, spindle_db_querylog_);
-	sql_set_errorlog(spindle->db, spindle_db_errorlog_);
-	sql_set_noticelog(spindle->db, spindle_db_noticelog_);
 	if(spindle_db_schema_update_(spindle))
 	{
 		return -1;
@@ -56,10 +67,31 @@ spindle_db_init(SPINDLE *spindle)
 	return 0;	
 }
 
+/* Give a forked worker process a database connection of its own. The
+ * inherited connection belongs to the parent and is abandoned rather than
+ * closed; the schema has already been brought up to date, and the inherited
+ * query statistics are discarded so that they're not reported twice.
+ */
+int
+spindle_db_reconnect(SPINDLE *spindle)
+{
+	spindle->db = NULL;
+	if(spindle_db_connect_(spindle))
+	{
+		return -1;
+	}
+	spindle_querystats_reset(spindle);
+	return 0;
+}
+
 /* Clean up resources used by a Spindle database connection */
 int
 spindle_db_cleanup(SPINDLE *spindle)
 {
+	spindle_querystats_cleanup(spindle);
+	free(spindle->graphseen);
+	spindle->graphseen = NULL;
+	spindle->ngraphseen = 0;
 	if(spindle->db)
 	{
 		sql_disconnect(spindle->db);
@@ -68,6 +100,325 @@ spindle_db_cleanup(SPINDLE *spindle)
 	return 0;
 }
 
+/* Execute a statement which returns a result-set, timing it for the query
+ * statistics
+ */
+SQL_STATEMENT *
+spindle_db_queryf(SQL *sql, const char *format, ...)
+{
+	SQL_STATEMENT *rs;
+	SPINDLE *spindle;
+	va_list ap;
+
+	spindle = (db_spindle && db_spindle->db == sql ? db_spindle : NULL);
+	if(spindle)
+	{
+		spindle_querystats_start(spindle);
+	}
+	va_start(ap, format);
+	rs = sql_vqueryf(sql, format, ap);
+	va_end(ap);
+	if(spindle)
+	{
+		spindle_querystats_end(spindle);
+	}
+	return rs;
+}
+
+/* Execute a statement which doesn't return a result-set, timing it for the
+ * query statistics
+ */
+int
+spindle_db_executef(SQL *sql, const char *format, ...)
+{
+	SPINDLE *spindle;
+	va_list ap;
+	int r;
+
+	spindle = (db_spindle && db_spindle->db == sql ? db_spindle : NULL);
+	if(spindle)
+	{
+		spindle_querystats_start(spindle);
+	}
+	va_start(ap, format);
+	r = sql_vexecutef(sql, format, ap);
+	va_end(ap);
+	if(spindle)
+	{
+		spindle_querystats_end(spindle);
+	}
+	return r;
+}
+
+/* Perform a transaction with sql_perform(), recording each attempt which
+ * fails and is retried against the statement which caused it
+ */
+int
+spindle_db_perform(SPINDLE *spindle, SQL *sql, SQL_PERFORM_TXN fn, void *data, SQL_TXN_MODE mode)
+{
+	struct spindle_db_perform_struct perform;
+
+	perform.spindle = spindle;
+	perform.fn = fn;
+	perform.data = data;
+	return sql_perform(sql, spindle_db_perform_, (void *) &perform, -1, mode);
+}
+
+/* The assignments used to mark state entries as dirty, given a relation "t"
+ * supplying the target "id", the trigger "flags" (or zero, meaning
+ * everything), the "priority" and the "debounce" interval in seconds.
+ *
+ * Every update advances the entry's epoch, which generation compares on
+ * completion to decide whether it must run again. Dirtying is coalesced:
+ *
+ * - A DIRTY entry keeps its place in the queue, merging the flags and taking
+ *   the more urgent priority.
+ * - An IN-PROGRESS entry is left with its current worker, and will be
+ *   re-queued by that worker when it completes.
+ * - Any other entry is queued, but not before the debounce interval has
+ *   passed since it was last generated.
+ */
+#define STATE_DIRTY_SET_ \
+	"\"status\" = CASE WHEN \"state\".\"status\" = 'IN-PROGRESS' THEN \"state\".\"status\" ELSE 'DIRTY' END, " \
+	"\"flags\" = CASE WHEN \"state\".\"status\" IN ('DIRTY', 'IN-PROGRESS') " \
+	"  THEN (CASE WHEN \"state\".\"flags\" <> 0 AND \"t\".\"flags\" <> 0 THEN \"state\".\"flags\" | \"t\".\"flags\" ELSE 0 END) " \
+	"  ELSE \"t\".\"flags\" END, " \
+	"\"epoch\" = \"state\".\"epoch\" + 1, " \
+	"\"priority\" = CASE WHEN \"state\".\"status\" IN ('DIRTY', 'IN-PROGRESS') " \
+	"  THEN LEAST(\"state\".\"priority\", \"t\".\"priority\") ELSE \"t\".\"priority\" END, " \
+	"\"queued\" = CASE WHEN \"state\".\"status\" IN ('DIRTY', 'IN-PROGRESS') " \
+	"  THEN COALESCE(\"state\".\"queued\", now() AT TIME ZONE 'UTC') " \
+	"  ELSE GREATEST(now() AT TIME ZONE 'UTC', COALESCE(\"state\".\"generated\", now() AT TIME ZONE 'UTC') + interval '1 second' * \"t\".\"debounce\") END"
+
+/* Mark an existing state entry as dirty, with the supplied trigger flags (or
+ * zero, meaning everything) and priority. If modified is non-NULL, the
+ * entry's modification timestamp is updated.
+ */
+int
+spindle_db_state_dirty(SPINDLE *spindle, SQL *sql, const char *id, int flags, int priority, const char *modified)
+{
+	if(spindle_db_executef(sql, "UPDATE \"state\" SET " STATE_DIRTY_SET_ ", "
+		"\"modified\" = CASE WHEN %d = 1 THEN %Q::timestamp ELSE \"state\".\"modified\" END "
+		"FROM (SELECT %Q::uuid AS \"id\", %d AS \"flags\", %d AS \"priority\", %d AS \"debounce\") \"t\" "
+		"WHERE \"state\".\"id\" = \"t\".\"id\"",
+		(modified ? 1 : 0), (modified ? modified : "1970-01-01 00:00:00"),
+		id, flags, priority, spindle->debounce))
+	{
+		return -1;
+	}
+	return 0;
+}
+
+/* Mark every entity with a trigger on 'triggerid' matching any of 'flags' as
+ * dirty, in a single statement; returns the number of entries updated
+ */
+int
+spindle_db_state_trigger(SPINDLE *spindle, SQL *sql, const char *triggerid, int flags, int priority)
+{
+	SQL_STATEMENT *rs;
+	int count;
+
+	/* The same target may be triggered by several of our URIs */
+	rs = spindle_db_queryf(sql, "WITH \"u\" AS ("
+		"UPDATE \"state\" SET " STATE_DIRTY_SET_ " "
+		"FROM ("
+		" SELECT \"id\", bit_or(\"flags\") AS \"flags\", %d AS \"priority\", %d AS \"debounce\" "
+		" FROM \"triggers\" "
+		" WHERE \"triggerid\" = %Q AND \"id\" <> \"triggerid\" AND (\"flags\" & %d) <> 0 "
+		" GROUP BY \"id\""
+		") \"t\" "
+		"WHERE \"state\".\"id\" = \"t\".\"id\" "
+		"RETURNING 1"
+		") SELECT count(*) FROM \"u\"",
+		priority, spindle->debounce, triggerid, flags);
+	if(!rs)
+	{
+		return -1;
+	}
+	count = sql_stmt_eof(rs) ? 0 : (int) sql_stmt_long(rs, 0);
+	sql_stmt_destroy(rs);
+	spindle_querystats_rows(spindle, count);
+	return count;
+}
+
+/* Record that a source graph has changed, so that any process caching its
+ * contents (or description) will discard them. This is executed outside of
+ * any transaction, before the entities drawing on the graph are marked as
+ * dirty, so that the change is visible by the time they're regenerated.
+ */
+int
+spindle_db_graph_changed(SPINDLE *spindle, const char *uri)
+{
+	if(!spindle->db)
+	{
+		return 0;
+	}
+	if(spindle_db_executef(spindle->db, "INSERT INTO \"graph_version\" (\"uri\", \"seq\", \"modified\", \"txid\") "
+		"VALUES (%Q, nextval('graph_version_seq'), now() AT TIME ZONE 'UTC', txid_current()) "
+		"ON CONFLICT (\"uri\") DO UPDATE SET \"seq\" = EXCLUDED.\"seq\", \"modified\" = EXCLUDED.\"modified\", \"txid\" = EXCLUDED.\"txid\"",
+		uri))
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": DB: failed to record change to graph <%s>\n", uri);
+		return -1;
+	}
+	return 0;
+}
+
+/* Obtain the sequence number of the most recent change recorded for each
+ * of a list of graphs, or zero for any graph which has no recorded change
+ */
+int
+spindle_db_graph_versions(SPINDLE *spindle, const char **uris, size_t count, long *versions)
+{
+	SQL_STATEMENT *rs;
+	const char *uri;
+	char *array;
+	size_t c;
+
+	for(c = 0; c < count; c++)
+	{
+		versions[c] = 0;
+	}
+	if(!spindle->db || !count)
+	{
+		return 0;
+	}
+	if(count == 1)
+	{
+		rs = spindle_db_queryf(spindle->db, "SELECT \"uri\", \"seq\" FROM \"graph_version\" WHERE \"uri\" = %Q", uris[0]);
+	}
+	else
+	{
+		if(!(array = spindle_db_strarray(uris, count)))
+		{
+			return -1;
+		}
+		rs = spindle_db_queryf(spindle->db, "SELECT \"uri\", \"seq\" FROM \"graph_version\" WHERE \"uri\" = ANY(%Q::text[])", array);
+		free(array);
+	}
+	if(!rs)
+	{
+		return -1;
+	}
+	for(; !sql_stmt_eof(rs); sql_stmt_next(rs))
+	{
+		if(!(uri = sql_stmt_str(rs, 0)))
+		{
+			continue;
+		}
+		for(c = 0; c < count; c++)
+		{
+			if(!strcmp(uris[c], uri))
+			{
+				versions[c] = sql_stmt_long(rs, 1);
+			}
+		}
+	}
+	sql_stmt_destroy(rs);
+	return 0;
+}
+
+/* Discard cached copies of any source graphs which have changed since the
+ * last check; this is called before every entity is generated, so that an
+ * entity is never generated from a graph which changed before it was
+ * marked dirty.
+ *
+ * Changes are found by the ID of the transaction which made them, rather
+ * than by sequence number, because sequence numbers can commit out of
+ * order. Each check also notes the oldest transaction still in progress:
+ * any change which wasn't yet visible was made by that transaction or a
+ * later one, and so will be found by the next check. Changes which were
+ * visible last time may be returned again, and are recognised by their
+ * sequence numbers.
+ *
+ * On the first check, nothing is cached in memory, but descriptions cached
+ * on disk by other processes may predate changes made while no process was
+ * checking, so graphs changed within the lifetime of those entries are
+ * discarded.
+ */
+int
+spindle_db_graph_sync(SPINDLE *spindle)
+{
+	SQL_STATEMENT *rs;
+	const char *uri;
+	long *seen, *p, seq;
+	size_t nseen, size;
+	int lookback, count;
+
+	if(!spindle->db)
+	{
+		return 0;
+	}
+	if(!spindle->graphpolled)
+	{
+		lookback = (spindle->diskcache && spindle->diskcache->ttl > 0 ? spindle->diskcache->ttl : 0);
+		rs = spindle_db_queryf(spindle->db, "SELECT \"s\".\"xmin\", \"v\".\"uri\", \"v\".\"seq\" "
+			"FROM (SELECT txid_snapshot_xmin(txid_current_snapshot()) AS \"xmin\") \"s\" "
+			"LEFT JOIN \"graph_version\" \"v\" ON \"v\".\"modified\" >= (now() AT TIME ZONE 'UTC') - interval '1 second' * %d AND %d > 0",
+			lookback, lookback);
+	}
+	else
+	{
+		rs = spindle_db_queryf(spindle->db, "SELECT \"s\".\"xmin\", \"v\".\"uri\", \"v\".\"seq\" "
+			"FROM (SELECT txid_snapshot_xmin(txid_current_snapshot()) AS \"xmin\") \"s\" "
+			"LEFT JOIN \"graph_version\" \"v\" ON \"v\".\"txid\" >= %ld",
+			spindle->graphxmin);
+	}
+	if(!rs)
+	{
+		return -1;
+	}
+	seen = NULL;
+	nseen = size = 0;
+	for(count = 0; !sql_stmt_eof(rs); sql_stmt_next(rs))
+	{
+		if(!count)
+		{
+			spindle->graphxmin = sql_stmt_long(rs, 0);
+		}
+		count++;
+		if(!(uri = sql_stmt_str(rs, 1)))
+		{
+			continue;
+		}
+		seq = sql_stmt_long(rs, 2);
+		if(nseen + 1 > size)
+		{
+			size = (size ? size * 2 : 16);
+			p = (long *) realloc(seen, sizeof(long) * size);
+			if(!p)
+			{
+				twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate memory for graph changes\n");
+				free(seen);
+				sql_stmt_destroy(rs);
+				return -1;
+			}
+			seen = p;
+		}
+		seen[nseen] = seq;
+		nseen++;
+		if(spindle->ngraphseen && bsearch(&seq, spindle->graphseen, spindle->ngraphseen, sizeof(long), spindle_db_seq_compare_))
+		{
+			/* Already discarded by the previous check */
+			continue;
+		}
+		twine_logf(LOG_DEBUG, PLUGIN_NAME ": discarding cached copies of updated graph <%s>\n", uri);
+		spindle_graphcache_discard(spindle, uri);
+	}
+	sql_stmt_destroy(rs);
+	spindle_querystats_rows(spindle, (long) nseen);
+	/* Keep the changes seen sorted, so that the next check can search them */
+	if(nseen > 1)
+	{
+		qsort(seen, nseen, sizeof(long), spindle_db_seq_compare_);
+	}
+	free(spindle->graphseen);
+	spindle->graphseen = seen;
+	spindle->ngraphseen = nseen;
+	spindle->graphpolled = 1;
+	return 0;
+}
+
 char *
 spindle_db_literalset(struct spindle_literalset_struct *set)
 {
@@ -127,16 +478,28 @@ spindle_db_literalset(struct spindle_literalset_struct *set)
 
 char *
 spindle_db_strset(struct spindle_strset_struct *set)
+{
+	return spindle_db_strarray((const char **) set->strings, set->count);
+}
+
+/* Format a list of strings as a PostgreSQL array literal; NULL entries
+ * become NULL elements
+ */
+char *
+spindle_db_strarray(const char **strings, size_t count)
 {
 	size_t c, nbytes;
 	char *str, *p;
 
 	nbytes = 3;
-	for(c = 0; c < set->count; c++)
+	for(c = 0; c < count; c++)
 	{
 		/* "string", */
-		nbytes += 3;
-		nbytes += spindle_db_esclen(set->strings[c]);
+		nbytes += 5;
+		if(strings[c])
+		{
+			nbytes += spindle_db_esclen(strings[c]);
+		}
 	}
 	str = (char *) malloc(nbytes);
 	if(!str)
@@ -147,16 +510,22 @@ spindle_db_strset(struct spindle_strset_struct *set)
 	p = str;
 	*p = '{';
 	p++;
-	for(c = 0; c < set->count; c++)
+	for(c = 0; c < count; c++)
 	{
 		if(c)
 		{
 			*p = ',';
 			p++;
 		}
+		if(!strings[c])
+		{
+			strcpy(p, "NULL");
+			p += 4;
+			continue;
+		}
 		*p = '"';
 		p++;
-		p = spindle_db_escstr(p, set->strings[c]);
+		p = spindle_db_escstr(p, strings[c]);
 		*p = '"';
 		p++;
 	}
@@ -326,6 +695,11 @@ spindle_db_querylog_(SQL *restrict sql, const char *query)
 {
 	(void) sql;
 
+	if(db_spindle)
+	{
+		spindle_stats_sql(db_spindle, strlen(query));
+		spindle_querystats_begin(db_spindle, query);
+	}
 	twine_logf(LOG_DEBUG, PLUGIN_NAME ": SQL: %s\n", query);
 	return 0;
 }
@@ -344,6 +718,66 @@ spindle_db_errorlog_(SQL *restrict sql, const char *sqlstate, const char *messag
 {
 	(void) sql;
 
+	if(db_spindle)
+	{
+		spindle_querystats_error(db_spindle, sqlstate);
+	}
+
 	twine_logf(LOG_ERR, PLUGIN_NAME ": [%s] %s\n", sqlstate, message);
 	return 0;
 }
+
+static int
+spindle_db_perform_(SQL *restrict sql, void *restrict userdata)
+{
+	struct spindle_db_perform_struct *perform;
+	int r;
+
+	perform = (struct spindle_db_perform_struct *) userdata;
+	spindle_querystats_attempt(perform->spindle);
+	r = perform->fn(sql, perform->data);
+	if(r == SQL_TXN_FAIL)
+	{
+		spindle_querystats_retry(perform->spindle);
+	}
+	return r;
+}
+
+/* Connect to the configured database, if any, and install the logging
+ * hooks
+ */
+static int
+spindle_db_connect_(SPINDLE *spindle)
+{
+	char *t;
+
+	t = twine_config_geta("spindle:db", NULL);
+	if(!t)
+	{
+		return 0;
+	}
+	spindle->db = sql_connect(t);
+	if(!spindle->db)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to connect to database <%s>\n", t);
+		free(t);
+		return -1;
+	}
+	free(t);
+	db_spindle = spindle;
+	sql_set_querylog(spindle->db, spindle_db_querylog_);
+	sql_set_errorlog(spindle->db, spindle_db_errorlog_);
+	sql_set_noticelog(spindle->db, spindle_db_noticelog_);
+	return 0;
+}
+
+/* Compare two graph change sequence numbers, for qsort() and bsearch() */
+static int
+spindle_db_seq_compare_(const void *a, const void *b)
+{
+	long la, lb;
+
+	la = *(const long *) a;
+	lb = *(const long *) b;
+	return (la > lb) - (la < lb);
+}
@@ -46,7 +46,42 @@ struct relate_struct
 	const char *uri;
 };
 
+/* Sentinel index used by the batch correlation union-find */
+#define NO_NODE                         ((size_t) -1)
+
+/* A single URI participating in a batch correlation */
+struct spindle_createset_node_struct
+{
+	const char *uri;
+	/* Union-find parent index */
+	size_t parent;
+	/* The node whose proxy the set will be unified onto (roots only) */
+	size_t target;
+	/* Changeset flags for the set (roots only) */
+	unsigned flags;
+	/* The UUID of the proxy this URI is currently related to, if any */
+	char id[36];
+};
+
+struct spindle_createset_struct
+{
+	SPINDLE *spindle;
+	struct spindle_corefset_struct *corefs;
+	struct spindle_strset_struct *changeset;
+	struct spindle_createset_node_struct *nodes;
+	size_t count;
+};
+
 static int spindle_db_perform_proxy_create_(SQL *restrict db, void *restrict userdata);
+static int spindle_db_perform_proxy_create_set_(SQL *restrict db, void *restrict userdata);
+static int spindle_db_createset_nodes_(struct spindle_createset_struct *data);
+static int spindle_db_createset_resolve_(SQL *restrict db, struct spindle_createset_struct *data);
+static struct spindle_createset_node_struct *spindle_db_createset_node_(struct spindle_createset_struct *data, const char *uri);
+static size_t spindle_db_createset_find_(struct spindle_createset_struct *data, size_t index);
+static int spindle_db_createset_compare_(const void *a, const void *b);
+static char *spindle_db_proxy_uri_(SPINDLE *spindle, const char *id);
+static int spindle_db_proxy_migrate_(SPINDLE *spindle, const char *oldid, const char *newid);
+static void spindle_db_uuid_copy_(char *dest, const char *src);
 static int spindle_db_perform_proxy_relate_(SQL *restrict db, void *restrict userdata);
 static int spindle_db_perform_proxy_state_(SQL *restrict db, void *restrict userdata);
 
@@ -63,7 +98,7 @@ spindle_db_proxy_create(SPINDLE *spindle, const char *uri1, const char *uri2, st
 	data.uri2 = uri2;
 	data.changeset = changeset;
 	data.id[0] = 0;
-	if(sql_perform(spindle->db, spindle_db_perform_proxy_create_, (void *) &data, -1, SQL_TXN_CONSISTENT) < 0)
+	if(spindle_db_perform(spindle, spindle->db, spindle_db_perform_proxy_create_, (void *) &data, SQL_TXN_CONSISTENT) < 0)
 	{
 		twine_logf(LOG_ERR, PLUGIN_NAME ": DB: failed to create proxy\n");
 		return -1;
@@ -84,14 +119,13 @@ char *
 spindle_db_proxy_locate(SPINDLE *spindle, const char *uri)
 {
 	SQL_STATEMENT *rs;
-	char *buf, *p;
-	const char *s;
+	char *buf;
 	
 	if(!uri)
 	{
 		return NULL;
 	}
-	rs = sql_queryf(spindle->db, "SELECT \"id\" FROM \"proxy\" WHERE %Q = ANY(\"sameas\")", uri);
+	rs = spindle_db_queryf(spindle->db, "SELECT \"id\" FROM \"proxy_uri\" WHERE \"uri\" = %Q", uri);
 	if(!rs)
 	{
 		return NULL;
@@ -101,47 +135,83 @@ spindle_db_proxy_locate(SPINDLE *spindle, const char *uri)
 		sql_stmt_destroy(rs);
 		return NULL;
 	}
-	/* root + '/' + uuid + '#id' + NUL */
-	/* XXX the fragment should be configurable */
-	buf = (char *) malloc(strlen(spindle->root) + 1 + 32 + 3 + 1);
-	if(!buf)
+	buf = spindle_db_proxy_uri_(spindle, sql_stmt_str(rs, 0));
+	sql_stmt_destroy(rs);
+	return buf;
+}
+
+/* Look up the proxies for a sorted batch of URIs with a single query */
+int
+spindle_db_proxy_locate_many(SPINDLE *spindle, struct spindle_locate_struct *list, size_t count)
+{
+	SQL_STATEMENT *rs;
+	const char **uris;
+	char *array, *localname;
+	size_t c, rows;
+	int r;
+
+	uris = (const char **) calloc(count, sizeof(const char *));
+	if(!uris)
 	{
-		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate buffer for proxy URI\n");
-		sql_stmt_destroy(rs);
-		return NULL;
+		return -1;
 	}
-	strcpy(buf, spindle->root);
-	p = strchr(buf, 0);
-	if(p > buf)
+	for(c = 0; c < count; c++)
 	{
-		p--;
-		if(*p == '/')
-		{
-			p++;
-		}
-		else
-		{
-			p++;
-			*p = '/';
-			p++;
-		}
+		uris[c] = list[c].uri;
 	}
-	else
+	array = spindle_db_strarray(uris, count);
+	free(uris);
+	if(!array)
 	{
-		*p = '/';
-		p++;
+		return -1;
 	}
-	for(s = sql_stmt_str(rs, 0); *s; s++)
+	rs = spindle_db_queryf(spindle->db, "SELECT \"uri\", \"id\" FROM \"proxy_uri\" WHERE \"uri\" = ANY(%Q::text[])", array);
+	free(array);
+	if(!rs)
 	{
-		if(isalnum(*s))
+		return -1;
+	}
+	r = 0;
+	for(rows = 0; !r && !sql_stmt_eof(rs); sql_stmt_next(rs))
+	{
+		rows++;
+		localname = spindle_db_proxy_uri_(spindle, sql_stmt_str(rs, 1));
+		if(!localname)
 		{
-			*p = tolower(*s);
-			p++;
+			r = -1;
+			break;
 		}
+		r = spindle_proxy_locate_found(list, count, sql_stmt_str(rs, 0), localname);
+		free(localname);
 	}
-	strcpy(p, "#id");
 	sql_stmt_destroy(rs);
-	return buf;
+	spindle_querystats_rows(spindle, (long) rows);
+	return r;
+}
+
+/* Assert all of the co-references in a set within a single transaction */
+int
+spindle_db_proxy_create_set(SPINDLE *spindle, struct spindle_corefset_struct *corefs, struct spindle_strset_struct *changeset)
+{
+	struct spindle_createset_struct data;
+
+	if(!corefs->refcount)
+	{
+		return 0;
+	}
+	data.spindle = spindle;
+	data.corefs = corefs;
+	data.changeset = changeset;
+	data.nodes = NULL;
+	data.count = 0;
+	if(spindle_db_perform(spindle, spindle->db, spindle_db_perform_proxy_create_set_, (void *) &data, SQL_TXN_CONSISTENT) < 0)
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": DB: failed to create proxies for co-reference set\n");
+		free(data.nodes);
+		return -1;
+	}
+	free(data.nodes);
+	return 0;
 }
 
 /* Store a relationship between a proxy and a processed entity */
@@ -182,7 +252,7 @@ spindle_db_proxy_refs(SPINDLE *spindle, const char *uri)
 		return NULL;
 	}
 	
-	rs = sql_queryf(spindle->db, "SELECT unnest(\"sameas\") AS \"uri\" FROM \"proxy\" WHERE \"id\" = %Q", id);
+	rs = spindle_db_queryf(spindle->db, "SELECT unnest(\"sameas\") AS \"uri\" FROM \"proxy\" WHERE \"id\" = %Q", id);
 	free(id);
 	if(!rs)
 	{
@@ -192,6 +262,7 @@ spindle_db_proxy_refs(SPINDLE *spindle, const char *uri)
 	{
 		count++;
 	}
+	spindle_querystats_rows(spindle, (long) count);
 	refset = (char **) calloc(count + 1, sizeof(char *));
 	if(!refset)
 	{
@@ -229,7 +300,7 @@ int
 spindle_db_proxy_migrate(SPINDLE *spindle, const char *from, const char *to, char **refs)
 {
 	char *oldid, *newid;
-	SQL_STATEMENT *rs;
+	int r;
 	
 	(void) refs;
 
@@ -241,42 +312,88 @@ spindle_db_proxy_migrate(SPINDLE *spindle, const char *from, const char *to, cha
 		free(newid);
 		return -1;
 	}
-	rs = sql_queryf(spindle->db, "SELECT * FROM \"moved\" WHERE \"from\" = %Q", oldid);
+	r = spindle_db_proxy_migrate_(spindle, oldid, newid);
+	if(r)
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": failed to migrate proxy <%s> to <%s>\n", oldid, newid);
+	}
+	free(oldid);
+	free(newid);
+	return r;
+}
+
+/* Perform the statements which move one proxy onto another, stopping at the
+ * first which fails
+ */
+static int
+spindle_db_proxy_migrate_(SPINDLE *spindle, const char *oldid, const char *newid)
+{
+	static const char *const repoint[] = {
+		"UPDATE \"proxy_uri\" SET \"id\" = %Q WHERE \"id\" = %Q",
+		"UPDATE \"triggers\" SET \"triggerid\" = %Q WHERE \"triggerid\" = %Q",
+		"UPDATE \"triggers\" SET \"id\" = %Q WHERE \"id\" = %Q",
+		"UPDATE \"audiences\" SET \"id\" = %Q WHERE \"id\" = %Q",
+		"UPDATE \"licenses_audiences\" SET \"id\" = %Q WHERE \"id\" = %Q",
+		"UPDATE \"licenses_audiences\" SET \"audienceid\" = %Q WHERE \"audienceid\" = %Q",
+		"UPDATE \"media\" SET \"id\" = %Q WHERE \"id\" = %Q",
+		"UPDATE \"membership\" SET \"id\" = %Q WHERE \"id\" = %Q",
+		"UPDATE \"membership\" SET \"collection\" = %Q WHERE \"collection\" = %Q",
+		"UPDATE \"index_media\" SET \"id\" = %Q WHERE \"id\" = %Q",
+		"UPDATE \"index_media\" SET \"media\" = %Q WHERE \"media\" = %Q",
+		"UPDATE \"about\" SET \"id\" = %Q WHERE \"id\" = %Q",
+		"UPDATE \"about\" SET \"about\" = %Q WHERE \"about\" = %Q",
+		NULL
+	};
+	SQL_STATEMENT *rs;
+	size_t c;
+	int r;
+
+	rs = spindle_db_queryf(spindle->db, "SELECT * FROM \"moved\" WHERE \"from\" = %Q", oldid);
 	if(!rs)
 	{
-		free(oldid);
-		free(newid);
 		return -1;
 	}
 	if(sql_stmt_eof(rs))
 	{
-		sql_executef(spindle->db, "INSERT INTO \"moved\" (\"from\", \"to\") VALUES (%Q, %Q)", oldid, newid);
+		r = spindle_db_executef(spindle->db, "INSERT INTO \"moved\" (\"from\", \"to\") VALUES (%Q, %Q)", oldid, newid);
 	}
 	else
 	{
-		sql_executef(spindle->db, "UPDATE \"moved\" SET \"to\" = %Q WHERE \"from\" = %Q", oldid, newid);
+		r = spindle_db_executef(spindle->db, "UPDATE \"moved\" SET \"to\" = %Q WHERE \"from\" = %Q", newid, oldid);
 	}
 	sql_stmt_destroy(rs);
-	sql_executef(spindle->db, "UPDATE \"proxy\" SET \"sameas\" = \"sameas\" || ( SELECT \"sameas\" FROM \"proxy\" WHERE \"id\" = %Q ) WHERE \"id\" = %Q", oldid, newid); 
-	sql_executef(spindle->db, "DELETE FROM \"proxy\" WHERE \"id\" = %Q", oldid);
-	sql_executef(spindle->db, "DELETE FROM \"index\" WHERE \"id\" = %Q", oldid);	
-	sql_executef(spindle->db, "UPDATE \"triggers\" SET \"triggerid\" = %Q WHERE \"triggerid\" = %Q", newid, oldid);
-	sql_executef(spindle->db, "UPDATE \"triggers\" SET \"id\" = %Q WHERE \"id\" = %Q", newid, oldid);
-	sql_executef(spindle->db, "UPDATE \"audiences\" SET \"id\" = %Q WHERE \"id\" = %Q", newid, oldid);
-	sql_executef(spindle->db, "UPDATE \"licenses_audiences\" SET \"id\" = %Q WHERE \"id\" = %Q", newid, oldid);
-	sql_executef(spindle->db, "UPDATE \"licenses_audiences\" SET \"audienceid\" = %Q WHERE \"audienceid\" = %Q", newid, oldid);
-	sql_executef(spindle->db, "UPDATE \"media\" SET \"id\" = %Q WHERE \"id\" = %Q", newid, oldid);
-	sql_executef(spindle->db, "UPDATE \"membership\" SET \"id\" = %Q WHERE \"id\" = %Q", newid, oldid);
-	sql_executef(spindle->db, "UPDATE \"membership\" SET \"collection\" = %Q WHERE \"collection\" = %Q", newid, oldid);
-	sql_executef(spindle->db, "UPDATE \"index_media\" SET \"id\" = %Q WHERE \"id\" = %Q", newid, oldid);
-	sql_executef(spindle->db, "UPDATE \"index_media\" SET \"media\" = %Q WHERE \"media\" = %Q", newid, oldid);
-	sql_executef(spindle->db, "UPDATE \"media\" SET \"id\" = %Q WHERE \"id\" = %Q", newid, oldid);
-	sql_executef(spindle->db, "UPDATE \"about\" SET \"id\" = %Q WHERE \"id\" = %Q", newid, oldid);
-	sql_executef(spindle->db, "UPDATE \"about\" SET \"about\" = %Q WHERE \"about\" = %Q", newid, oldid);
-	spindle_db_proxy_state_(spindle, newid, 1);
-	sql_executef(spindle->db, "DELETE FROM \"state\" WHERE \"id\" = %Q", oldid);
-	free(oldid);
-	free(newid);
+	if(r)
+	{
+		return -1;
+	}
+	if(spindle_db_executef(spindle->db, "UPDATE \"proxy\" SET \"sameas\" = \"sameas\" || ( SELECT \"sameas\" FROM \"proxy\" WHERE \"id\" = %Q ) WHERE \"id\" = %Q", oldid, newid) ||
+	   spindle_db_executef(spindle->db, "DELETE FROM \"proxy\" WHERE \"id\" = %Q", oldid) ||
+	   spindle_db_executef(spindle->db, "DELETE FROM \"index\" WHERE \"id\" = %Q", oldid))
+	{
+		return -1;
+	}
+	/* A trigger on the same URI for both proxies would violate the
+	 * uniqueness of ("id", "uri") once re-pointed; keep the new proxy's
+	 */
+	if(spindle_db_executef(spindle->db, "DELETE FROM \"triggers\" \"o\" USING \"triggers\" \"n\" WHERE \"o\".\"id\" = %Q AND \"n\".\"id\" = %Q AND \"o\".\"uri\" = \"n\".\"uri\"", oldid, newid))
+	{
+		return -1;
+	}
+	for(c = 0; repoint[c]; c++)
+	{
+		if(spindle_db_executef(spindle->db, repoint[c], newid, oldid))
+		{
+			return -1;
+		}
+	}
+	if(spindle_db_proxy_state_(spindle, newid, 1))
+	{
+		return -1;
+	}
+	if(spindle_db_executef(spindle->db, "DELETE FROM \"state\" WHERE \"id\" = %Q", oldid))
+	{
+		return -1;
+	}
 	return 0;
 }
 
@@ -290,7 +407,7 @@ spindle_db_proxy_state_(SPINDLE *spindle, const char *id, int changed)
 	data.spindle = spindle;
 	data.id = id;
 	data.changed = changed;
-	return sql_perform(spindle->db, spindle_db_perform_proxy_state_, (void *) &data, -1, SQL_TXN_CONSISTENT);
+	return spindle_db_perform(spindle, spindle->db, spindle_db_perform_proxy_state_, (void *) &data, SQL_TXN_CONSISTENT);
 }
 
 static int
@@ -304,7 +421,7 @@ spindle_db_perform_proxy_state_(SQL *restrict db, void *restrict userdata)
 	struct tm tm;
 
 	data = (struct spindle_state_struct *) userdata;
-	rs = sql_queryf(db, "SELECT \"id\" FROM \"state\" WHERE \"id\" = %Q", data->id);
+	rs = spindle_db_queryf(db, "SELECT \"id\" FROM \"state\" WHERE \"id\" = %Q", data->id);
 	if(!rs)
 	{
 		return SQL_TXN_FAIL;
@@ -318,8 +435,8 @@ spindle_db_perform_proxy_state_(SQL *restrict db, void *restrict userdata)
 	if(sql_stmt_eof(rs))
 	{
 		/* The entry doesn't already exist, create it */
-		if(sql_executef(db, "INSERT INTO \"state\" (\"id\", \"shorthash\", \"tinyhash\", \"status\", \"modified\", \"flags\") VALUES (%Q, '%lu', '%d', %Q, %Q, 0)",
-			data->id, (unsigned long) shortkey, (int) (shortkey % 256), "DIRTY", tbuf
+		if(spindle_db_executef(db, "INSERT INTO \"state\" (\"id\", \"shorthash\", \"tinyhash\", \"status\", \"modified\", \"flags\", \"priority\", \"queued\") VALUES (%Q, '%lu', '%d', %Q, %Q, 0, %d, %Q)",
+			data->id, (unsigned long) shortkey, (int) (shortkey % 256), "DIRTY", tbuf, SPINDLE_PRIO_NORMAL, tbuf
 			))
 		{
 			sql_stmt_destroy(rs);
@@ -334,8 +451,7 @@ spindle_db_perform_proxy_state_(SQL *restrict db, void *restrict userdata)
 	 */
 	if(data->changed)
 	{
-		if(sql_executef(db, "UPDATE \"state\" SET \"status\" = %Q, \"flags\" = 0, \"modified\" = %Q WHERE \"id\" = %Q",
-			"DIRTY", tbuf, data->id))
+		if(spindle_db_state_dirty(data->spindle, db, data->id, 0, SPINDLE_PRIO_NORMAL, tbuf))
 		{
 			return SQL_TXN_FAIL;
 		}
@@ -495,36 +611,389 @@ spindle_db_perform_proxy_relate_(SQL *restrict db, void *restrict userdata)
 	SQL_STATEMENT *rs;
 	
 	data = (struct relate_struct *) userdata;
-	rs = sql_queryf(db, "SELECT \"id\" FROM \"proxy\" WHERE \"id\" = %Q", data->id);
+	rs = spindle_db_queryf(db, "SELECT \"id\" FROM \"proxy\" WHERE \"id\" = %Q", data->id);
 	if(!rs)
 	{
 		return -2;
 	}
 	if(sql_stmt_eof(rs))
 	{
-		if(sql_executef(db, "INSERT INTO \"proxy\" (\"id\", \"sameas\") VALUES (%Q, ARRAY[]::text[])", data->id))
+		if(spindle_db_executef(db, "INSERT INTO \"proxy\" (\"id\", \"sameas\") VALUES (%Q, ARRAY[]::text[])", data->id))
 		{
 			sql_stmt_destroy(rs);
 			return -2;
 		}
 	}
 	sql_stmt_destroy(rs);
-	if(sql_executef(db, "UPDATE \"proxy\" SET \"sameas\" = array_append(\"sameas\", %Q) WHERE \"id\" = %Q", data->uri, data->id))
+	if(spindle_db_executef(db, "UPDATE \"proxy\" SET \"sameas\" = array_append(\"sameas\", %Q) WHERE \"id\" = %Q", data->uri, data->id))
+	{
+		return -2;
+	}
+	if(spindle_db_executef(db, "INSERT INTO \"proxy_uri\" (\"uri\", \"id\") VALUES (%Q, %Q) "
+		"ON CONFLICT (\"uri\") DO UPDATE SET \"id\" = EXCLUDED.\"id\"", data->uri, data->id))
 	{
 		return -2;
 	}
 	/* Update any indexes which refer to this URI */
-	if(sql_executef(db, "UPDATE \"triggers\" SET \"triggerid\" = %Q WHERE \"uri\" = %Q", data->id, data->uri))
+	if(spindle_db_executef(db, "UPDATE \"triggers\" SET \"triggerid\" = %Q WHERE \"uri\" = %Q", data->id, data->uri))
 	{
 		return -2;
 	}
-	if(sql_executef(db, "UPDATE \"audiences\" SET \"id\" = %Q WHERE \"uri\" = %Q", data->id, data->uri))
+	if(spindle_db_executef(db, "UPDATE \"audiences\" SET \"id\" = %Q WHERE \"uri\" = %Q", data->id, data->uri))
 	{
 		return -2;
 	}
-	if(sql_executef(db, "UPDATE \"licenses_audiences\" SET \"audienceid\" = %Q WHERE \"uri\" = %Q", data->id, data->uri))
+	if(spindle_db_executef(db, "UPDATE \"licenses_audiences\" SET \"audienceid\" = %Q WHERE \"uri\" = %Q", data->id, data->uri))
 	{
 		return -2;
 	}
 	return 1;
 }
+
+/* Perform a batch correlation: resolve every URI in the co-reference set
+ * with a single query, group them using union-find, and then apply all of
+ * the relations, migrations and state updates within this transaction.
+ */
+static int
+spindle_db_perform_proxy_create_set_(SQL *restrict db, void *restrict userdata)
+{
+	struct spindle_createset_struct *data;
+	struct spindle_createset_node_struct *node, *root, *target;
+	struct spindle_state_struct state;
+	struct relate_struct relate;
+	char oldid[36];
+	char *uu;
+	size_t c, n, r, s;
+	int side;
+
+	data = (struct spindle_createset_struct *) userdata;
+	/* This callback may be re-invoked if the transaction must be retried,
+	 * so always start from scratch
+	 */
+	if(spindle_db_createset_nodes_(data))
+	{
+		return SQL_TXN_ABORT;
+	}
+	if(spindle_db_createset_resolve_(db, data))
+	{
+		return SQL_TXN_FAIL;
+	}
+	/* Merge each pair of co-references into a single set */
+	for(c = 0; c < data->corefs->refcount; c++)
+	{
+		if(!data->corefs->refs[c].right)
+		{
+			continue;
+		}
+		r = spindle_db_createset_find_(data, spindle_db_createset_node_(data, data->corefs->refs[c].left) - data->nodes);
+		s = spindle_db_createset_find_(data, spindle_db_createset_node_(data, data->corefs->refs[c].right) - data->nodes);
+		if(r != s)
+		{
+			data->nodes[s].parent = r;
+		}
+	}
+	/* Pick the proxy which each set will be unified onto: as with
+	 * spindle_db_proxy_create(), this is the first existing proxy found
+	 * in co-reference order, otherwise the first URI will be given a new
+	 * proxy.
+	 */
+	for(c = 0; c < data->corefs->refcount; c++)
+	{
+		for(side = 0; side < 2; side++)
+		{
+			node = spindle_db_createset_node_(data, side ? data->corefs->refs[c].right : data->corefs->refs[c].left);
+			if(!node)
+			{
+				continue;
+			}
+			root = &(data->nodes[spindle_db_createset_find_(data, node - data->nodes)]);
+			if(root->target == NO_NODE || (node->id[0] && !data->nodes[root->target].id[0]))
+			{
+				root->target = node - data->nodes;
+			}
+		}
+	}
+	for(n = 0; n < data->count; n++)
+	{
+		root = &(data->nodes[n]);
+		if(root->parent != n)
+		{
+			continue;
+		}
+		target = &(data->nodes[root->target]);
+		root->flags = SF_REFRESHED;
+		if(!target->id[0])
+		{
+			uu = spindle_proxy_generate(data->spindle, target->uri);
+			if(!uu)
+			{
+				return SQL_TXN_ABORT;
+			}
+			spindle_db_id_copy(target->id, uu);
+			free(uu);
+			twine_logf(LOG_INFO, PLUGIN_NAME ": DB: new proxy %s for <%s>\n", target->id, target->uri);
+			/* The target doesn't have a proxy_uri row yet */
+			root->flags |= SF_MOVED;
+			relate.spindle = data->spindle;
+			relate.id = target->id;
+			relate.uri = target->uri;
+			if(spindle_db_perform_proxy_relate_(db, (void *) &relate) < 0)
+			{
+				return SQL_TXN_FAIL;
+			}
+		}
+	}
+	/* Relate or migrate everything which isn't already attached to the
+	 * chosen proxy
+	 */
+	for(n = 0; n < data->count; n++)
+	{
+		node = &(data->nodes[n]);
+		root = &(data->nodes[spindle_db_createset_find_(data, n)]);
+		target = &(data->nodes[root->target]);
+		if(!strcmp(node->id, target->id))
+		{
+			continue;
+		}
+		if(!node->id[0])
+		{
+			twine_logf(LOG_DEBUG, PLUGIN_NAME ": DB: relating %s to %s\n", node->uri, target->id);
+			relate.spindle = data->spindle;
+			relate.id = target->id;
+			relate.uri = node->uri;
+			if(spindle_db_perform_proxy_relate_(db, (void *) &relate) < 0)
+			{
+				return SQL_TXN_FAIL;
+			}
+			strcpy(node->id, target->id);
+			root->flags |= SF_MOVED;
+			continue;
+		}
+		/* This URI is attached to a different proxy, so move all of that
+		 * proxy's references over to the target
+		 */
+		strcpy(oldid, node->id);
+		twine_logf(LOG_INFO, PLUGIN_NAME ": DB: relocating references from %s to %s\n", oldid, target->id);
+		if(spindle_db_proxy_migrate(data->spindle, oldid, target->id, NULL))
+		{
+			return SQL_TXN_FAIL;
+		}
+		for(c = 0; c < data->count; c++)
+		{
+			if(!strcmp(data->nodes[c].id, oldid))
+			{
+				strcpy(data->nodes[c].id, target->id);
+			}
+		}
+		root->flags |= SF_MOVED;
+		if(data->changeset && (uu = spindle_db_proxy_uri_(data->spindle, oldid)))
+		{
+			spindle_strset_add_flags(data->changeset, uu, root->flags);
+			free(uu);
+		}
+	}
+	/* Finally, mark each of the resulting proxies as needing to be
+	 * re-generated
+	 */
+	for(n = 0; n < data->count; n++)
+	{
+		root = &(data->nodes[n]);
+		if(root->parent != n)
+		{
+			continue;
+		}
+		target = &(data->nodes[root->target]);
+		if(data->changeset && (uu = spindle_db_proxy_uri_(data->spindle, target->id)))
+		{
+			spindle_strset_add_flags(data->changeset, uu, root->flags);
+			free(uu);
+		}
+		state.spindle = data->spindle;
+		state.id = target->id;
+		state.changed = 1;
+		if(spindle_db_perform_proxy_state_(db, (void *) &state) == SQL_TXN_FAIL)
+		{
+			return SQL_TXN_FAIL;
+		}
+	}
+	return SQL_TXN_COMMIT;
+}
+
+/* Build the sorted, de-duplicated list of URIs in a co-reference set */
+static int
+spindle_db_createset_nodes_(struct spindle_createset_struct *data)
+{
+	struct spindle_createset_node_struct *p;
+	size_t c, n;
+
+	free(data->nodes);
+	data->count = 0;
+	data->nodes = (struct spindle_createset_node_struct *) calloc(data->corefs->refcount * 2, sizeof(struct spindle_createset_node_struct));
+	if(!data->nodes)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate memory for co-reference batch\n");
+		return -1;
+	}
+	p = data->nodes;
+	for(c = 0; c < data->corefs->refcount; c++)
+	{
+		p->uri = data->corefs->refs[c].left;
+		p++;
+		if(data->corefs->refs[c].right)
+		{
+			p->uri = data->corefs->refs[c].right;
+			p++;
+		}
+	}
+	n = p - data->nodes;
+	qsort(data->nodes, n, sizeof(struct spindle_createset_node_struct), spindle_db_createset_compare_);
+	for(c = 0; c < n; c++)
+	{
+		if(data->count && !strcmp(data->nodes[data->count - 1].uri, data->nodes[c].uri))
+		{
+			continue;
+		}
+		data->nodes[data->count].uri = data->nodes[c].uri;
+		data->nodes[data->count].parent = data->count;
+		data->nodes[data->count].target = NO_NODE;
+		data->nodes[data->count].flags = 0;
+		data->nodes[data->count].id[0] = 0;
+		data->count++;
+	}
+	return 0;
+}
+
+/* Obtain the existing proxy (if any) for every URI in the batch */
+static int
+spindle_db_createset_resolve_(SQL *restrict db, struct spindle_createset_struct *data)
+{
+	struct spindle_createset_node_struct *node;
+	SQL_STATEMENT *rs;
+	const char **uris;
+	char *array;
+	size_t c;
+
+	uris = (const char **) malloc(sizeof(const char *) * (data->count ? data->count : 1));
+	if(!uris)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate memory for URI array\n");
+		return -1;
+	}
+	for(c = 0; c < data->count; c++)
+	{
+		uris[c] = data->nodes[c].uri;
+	}
+	array = spindle_db_strarray(uris, data->count);
+	free(uris);
+	if(!array)
+	{
+		return -1;
+	}
+	rs = spindle_db_queryf(db, "SELECT \"uri\", \"id\" FROM \"proxy_uri\" WHERE \"uri\" = ANY(%Q::text[])", array);
+	free(array);
+	if(!rs)
+	{
+		return -1;
+	}
+	for(; !sql_stmt_eof(rs); sql_stmt_next(rs))
+	{
+		node = spindle_db_createset_node_(data, sql_stmt_str(rs, 0));
+		if(node)
+		{
+			spindle_db_uuid_copy_(node->id, sql_stmt_str(rs, 1));
+		}
+	}
+	sql_stmt_destroy(rs);
+	return 0;
+}
+
+static struct spindle_createset_node_struct *
+spindle_db_createset_node_(struct spindle_createset_struct *data, const char *uri)
+{
+	struct spindle_createset_node_struct key;
+
+	if(!uri)
+	{
+		return NULL;
+	}
+	key.uri = uri;
+	return (struct spindle_createset_node_struct *) bsearch(&key, data->nodes, data->count, sizeof(struct spindle_createset_node_struct), spindle_db_createset_compare_);
+}
+
+/* Union-find lookup with path halving */
+static size_t
+spindle_db_createset_find_(struct spindle_createset_struct *data, size_t index)
+{
+	while(data->nodes[index].parent != index)
+	{
+		data->nodes[index].parent = data->nodes[data->nodes[index].parent].parent;
+		index = data->nodes[index].parent;
+	}
+	return index;
+}
+
+static int
+spindle_db_createset_compare_(const void *a, const void *b)
+{
+	return strcmp(((const struct spindle_createset_node_struct *) a)->uri, ((const struct spindle_createset_node_struct *) b)->uri);
+}
+
+/* Generate a proxy URI from a UUID */
+static char *
+spindle_db_proxy_uri_(SPINDLE *spindle, const char *id)
+{
+	char *buf, *p;
+
+	/* root + '/' + uuid + '#id' + NUL */
+	/* XXX the fragment should be configurable */
+	buf = (char *) malloc(strlen(spindle->root) + 1 + 32 + 3 + 1);
+	if(!buf)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate buffer for proxy URI\n");
+		return NULL;
+	}
+	strcpy(buf, spindle->root);
+	p = strchr(buf, 0);
+	if(p > buf)
+	{
+		p--;
+		if(*p == '/')
+		{
+			p++;
+		}
+		else
+		{
+			p++;
+			*p = '/';
+			p++;
+		}
+	}
+	else
+	{
+		*p = '/';
+		p++;
+	}
+	spindle_db_uuid_copy_(p, id);
+	strcat(p, "#id");
+	return buf;
+}
+
+/* Copy a UUID as returned by the database into a buffer, stripping any
+ * punctuation
+ */
+static void
+spindle_db_uuid_copy_(char *dest, const char *src)
+{
+	size_t c;
+
+	for(c = 0; *src && c < 32; src++)
+	{
+		if(isalnum(*src))
+		{
+			*dest = tolower(*src);
+			dest++;
+			c++;
+		}
+	}
+	*dest = 0;
+}
@@ -27,7 +27,7 @@
  * 1..DB_SCHEMA_VERSION must be handled individually in spindle_db_migrate_
  * below.
  */
-#define DB_SCHEMA_VERSION               28
+#define DB_SCHEMA_VERSION               36
 
 static int spindle_db_migrate_(SQL *restrict, const char *identifier, int newversion, void *restrict userdata);
 
@@ -530,6 +530,179 @@ spindle_db_migrate_(SQL *restrict sql, const char *identifier, int newversion, v
 		}
 		return 0;
 	}
+	if(newversion == 29)
+	{
+		/* Normalised URI => proxy mapping, so that proxy lookups don't need
+		 * to scan every "sameas" array
+		 */
+		if(sql_execute(sql, "CREATE TABLE \"proxy_uri\" ("
+			"  \"uri\" text NOT NULL, "
+			"  \"id\" uuid NOT NULL, "
+			"  PRIMARY KEY (\"uri\")"
+			")"))
+		{
+			return -1;
+		}
+		if(sql_execute(sql, "CREATE INDEX \"proxy_uri_id\" ON \"proxy_uri\" (\"id\")"))
+		{
+			return -1;
+		}
+		/* Back-fill from the existing proxies; if a URI has somehow ended up
+		 * in more than one proxy, pick one of them consistently
+		 */
+		if(sql_execute(sql, "INSERT INTO \"proxy_uri\" (\"uri\", \"id\") "
+			"SELECT DISTINCT ON (\"uri\") \"uri\", \"id\" FROM ("
+			"  SELECT unnest(\"sameas\") AS \"uri\", \"id\" FROM \"proxy\""
+			") AS \"refs\" "
+			"WHERE \"uri\" IS NOT NULL "
+			"ORDER BY \"uri\", \"id\""))
+		{
+			return -1;
+		}
+		return 0;
+	}
+	if(newversion == 30)
+	{
+		/* Progress of bulk re-generation workers */
+		if(sql_execute(sql, "CREATE TABLE \"generate_checkpoint\" ("
+			"  \"workers\" integer NOT NULL, "
+			"  \"worker\" integer NOT NULL, "
+			"  \"lastid\" uuid default NULL, "
+			"  \"complete\" boolean NOT NULL default false, "
+			"  \"processed\" bigint NOT NULL default 0, "
+			"  \"failed\" bigint NOT NULL default 0, "
+			"  \"modified\" timestamp without time zone NOT NULL, "
+			"  PRIMARY KEY (\"workers\", \"worker\")"
+			")"))
+		{
+			return -1;
+		}
+		return 0;
+	}
+	if(newversion == 31)
+	{
+		/* This can't be executed within the transaction */
+		if(sql_commit(sql))
+		{
+			return -1;
+		}
+		if(sql_execute(sql, "ALTER TYPE \"state_status\" ADD VALUE 'IN-PROGRESS'"))
+		{
+			return -1;
+		}
+		if(sql_begin(sql, SQL_TXN_CONSISTENT))
+		{
+			return -1;
+		}
+		/* Expiry time of the MQ lease on an IN-PROGRESS entry */
+		if(sql_execute(sql, "ALTER TABLE \"state\" ADD COLUMN \"leased\" TIMESTAMP default NULL"))
+		{
+			return -1;
+		}
+		return 0;
+	}
+	if(newversion == 32)
+	{
+		/* Queue priority (lower is more urgent) and the time at which the
+		 * entry was last marked as dirty
+		 */
+		if(sql_executef(sql, "ALTER TABLE \"state\" ADD COLUMN \"priority\" integer NOT NULL default %d", SPINDLE_PRIO_NORMAL))
+		{
+			return -1;
+		}
+		if(sql_execute(sql, "ALTER TABLE \"state\" ADD COLUMN \"queued\" TIMESTAMP default NULL"))
+		{
+			return -1;
+		}
+		if(sql_execute(sql, "UPDATE \"state\" SET \"queued\" = \"modified\" WHERE \"status\" IN ('DIRTY', 'IN-PROGRESS')"))
+		{
+			return -1;
+		}
+		if(sql_execute(sql, "CREATE INDEX \"state_queue\" ON \"state\" (\"priority\", \"queued\") WHERE \"status\" IN ('DIRTY', 'IN-PROGRESS')"))
+		{
+			return -1;
+		}
+		return 0;
+	}
+	if(newversion == 33)
+	{
+		/* Incremented each time the entry is marked dirty, so that a
+		 * generation run can tell whether it raced with a further update
+		 */
+		if(sql_execute(sql, "ALTER TABLE \"state\" ADD COLUMN \"epoch\" bigint NOT NULL default 0"))
+		{
+			return -1;
+		}
+		/* The time at which the entry was last generated */
+		if(sql_execute(sql, "ALTER TABLE \"state\" ADD COLUMN \"generated\" TIMESTAMP default NULL"))
+		{
+			return -1;
+		}
+		return 0;
+	}
+	if(newversion == 34)
+	{
+		/* Covering index for trigger fan-out, which supersedes the index
+		 * on "triggerid" alone
+		 */
+		if(sql_execute(sql, "CREATE INDEX \"triggers_triggerid_flags\" ON \"triggers\" (\"triggerid\", \"flags\", \"id\")"))
+		{
+			return -1;
+		}
+		if(sql_execute(sql, "DROP INDEX IF EXISTS \"triggers_triggerid\""))
+		{
+			return -1;
+		}
+		return 0;
+	}
+	if(newversion == 35)
+	{
+		/* Each entity has at most one trigger per URI; discard any
+		 * duplicates before enforcing that
+		 */
+		if(sql_execute(sql, "DELETE FROM \"triggers\" \"a\" USING \"triggers\" \"b\" "
+			"WHERE \"a\".\"id\" = \"b\".\"id\" AND \"a\".\"uri\" = \"b\".\"uri\" AND \"a\".\"ctid\" < \"b\".\"ctid\""))
+		{
+			return -1;
+		}
+		if(sql_execute(sql, "ALTER TABLE \"triggers\" ADD CONSTRAINT \"triggers_id_uri\" UNIQUE (\"id\", \"uri\")"))
+		{
+			return -1;
+		}
+		/* The unique index on (id, uri) supersedes the index on "id" */
+		if(sql_execute(sql, "DROP INDEX IF EXISTS \"triggers_id\""))
+		{
+			return -1;
+		}
+		return 0;
+	}
+	if(newversion == 36)
+	{
+		/* The most recent change to each source graph, so that processes
+		 * caching graphs can discard those which have changed; sequence
+		 * numbers can commit out of order, so changes are found by the
+		 * (epoch-extended) ID of the transaction which made them
+		 */
+		if(sql_execute(sql, "CREATE SEQUENCE \"graph_version_seq\""))
+		{
+			return -1;
+		}
+		if(sql_execute(sql, "CREATE TABLE \"graph_version\" ("
+			"  \"uri\" text NOT NULL, "
+			"  \"seq\" bigint NOT NULL, "
+			"  \"modified\" timestamp without time zone NOT NULL, "
+			"  \"txid\" bigint NOT NULL DEFAULT txid_current(), "
+			"  PRIMARY KEY (\"uri\")"
+			")"))
+		{
+			return -1;
+		}
+		if(sql_execute(sql, "CREATE INDEX \"graph_version_txid\" ON \"graph_version\" (\"txid\")"))
+		{
+			return -1;
+		}
+		return 0;
+	}
 	twine_logf(LOG_NOTICE, PLUGIN_NAME ": unsupported database schema version %d\n", newversion);
 	return -1;
 }
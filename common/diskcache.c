@@ -0,0 +1,348 @@
+/* Spindle: Co-reference aggregation engine
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_spindle.h"
+
+/* An on-disk cache of graph descriptions, shared by every process on a host
+ * which is configured with the same spindle:graphdesc-cache directory.
+ *
+ * Each description is held in its own file, named for a hash of the graph
+ * URI and placed in one of 256 sub-directories. A file consists of a
+ * fixed-size header, the graph URI (so that hash collisions are detected),
+ * and the description as N-Quads. Files are written to a temporary name and
+ * renamed into place, so that readers never see a partial file, and are read
+ * by mapping them into memory and parsing the mapping directly.
+ *
+ * The header records when the description was fetched from the quad-store
+ * and, when there is a database, the sequence number of the most recent
+ * change to the graph recorded in the graph_version table at that time;
+ * both are noted before the query is issued, so that a description fetched
+ * concurrently with a change is never mistaken for a current one. An entry
+ * is valid until it is older than spindle:graphdesc-ttl, or until the graph
+ * has a more recent recorded change.
+ */
+
+#define DISKCACHE_MAGIC                 "SPGDESC2"
+
+struct spindle_diskcache_header_struct
+{
+	char magic[8];
+	uint64_t fetched;
+	int64_t version;
+	uint32_t urilen;
+	uint32_t datalen;
+};
+
+static int spindle_diskcache_path_(struct spindle_diskcache_struct *cache, const char *uri, char *buf, size_t bufsize);
+static int spindle_diskcache_write_(int fd, const char *buf, size_t len);
+
+/* Enable the on-disk graph description cache, if configured */
+int
+spindle_diskcache_init(SPINDLE *spindle)
+{
+	struct spindle_diskcache_struct *cache;
+	char *path;
+	size_t len;
+
+	path = twine_config_geta("spindle:graphdesc-cache", NULL);
+	if(!path || !path[0])
+	{
+		free(path);
+		return 0;
+	}
+	len = strlen(path);
+	while(len > 1 && path[len - 1] == '/')
+	{
+		len--;
+		path[len] = 0;
+	}
+	if(mkdir(path, 0777) && errno != EEXIST)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to create graph description cache directory %s: %s\n", path, strerror(errno));
+		free(path);
+		return -1;
+	}
+	cache = (struct spindle_diskcache_struct *) calloc(1, sizeof(struct spindle_diskcache_struct));
+	if(!cache)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate graph description cache\n");
+		free(path);
+		return -1;
+	}
+	cache->path = path;
+	cache->ttl = twine_config_get_int("spindle:graphdesc-ttl", SPINDLE_DISKCACHE_TTL);
+	spindle->diskcache = cache;
+	twine_logf(LOG_INFO, PLUGIN_NAME ": graph descriptions will be cached in %s\n", path);
+	return 0;
+}
+
+/* Disable the on-disk graph description cache */
+int
+spindle_diskcache_cleanup(SPINDLE *spindle)
+{
+	struct spindle_diskcache_struct *cache;
+
+	if(!(cache = spindle->diskcache))
+	{
+		return 0;
+	}
+	twine_logf(LOG_DEBUG, PLUGIN_NAME ": diskcache: %lu hits, %lu misses, %lu expired, %lu stale\n", cache->hits, cache->misses, cache->expired, cache->stale);
+	free(cache->path);
+	free(cache);
+	spindle->diskcache = NULL;
+	return 0;
+}
+
+/* Look up the description of a graph in the on-disk cache, adding it to
+ * @model if it is present and still valid; @version is the graph's most
+ * recent recorded change (see spindle_db_graph_versions()), which the cached
+ * description must reflect. Returns 1 if it was found, 0 if not, or -1 on
+ * error.
+ */
+int
+spindle_diskcache_fetch(SPINDLE *spindle, const char *uri, librdf_model *model, long version)
+{
+	struct spindle_diskcache_struct *cache;
+	struct spindle_diskcache_header_struct header;
+	char path[PATH_MAX];
+	const char *base;
+	struct stat sb;
+	void *map;
+	size_t urilen;
+	int fd, r;
+
+	if(!(cache = spindle->diskcache))
+	{
+		return 0;
+	}
+	if(spindle_diskcache_path_(cache, uri, path, sizeof(path)))
+	{
+		return 0;
+	}
+	fd = open(path, O_RDONLY);
+	if(fd == -1)
+	{
+		cache->misses++;
+		return 0;
+	}
+	if(fstat(fd, &sb) || (size_t) sb.st_size < sizeof(header))
+	{
+		close(fd);
+		cache->misses++;
+		return 0;
+	}
+	map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+	{
+		twine_logf(LOG_WARNING, PLUGIN_NAME ": diskcache: failed to map %s: %s\n", path, strerror(errno));
+		cache->misses++;
+		return 0;
+	}
+	memcpy(&header, map, sizeof(header));
+	base = (const char *) map + sizeof(header);
+	urilen = strlen(uri);
+	if(memcmp(header.magic, DISKCACHE_MAGIC, sizeof(header.magic)) ||
+	   (size_t) sb.st_size != sizeof(header) + header.urilen + header.datalen ||
+	   header.urilen != urilen || memcmp(base, uri, urilen))
+	{
+		/* A different graph whose URI has the same hash, or a file written
+		 * by an incompatible version
+		 */
+		munmap(map, sb.st_size);
+		cache->misses++;
+		return 0;
+	}
+	if(cache->ttl > 0 && (time_t) header.fetched + cache->ttl <= time(NULL))
+	{
+		munmap(map, sb.st_size);
+		cache->expired++;
+		return 0;
+	}
+	if(spindle->db && version != (long) header.version)
+	{
+		/* The graph has changed since the description was fetched */
+		munmap(map, sb.st_size);
+		cache->stale++;
+		return 0;
+	}
+	r = 0;
+	if(header.datalen)
+	{
+		r = twine_rdf_model_parse(model, MIME_NQUADS, base + urilen, header.datalen);
+	}
+	munmap(map, sb.st_size);
+	if(r)
+	{
+		twine_logf(LOG_WARNING, PLUGIN_NAME ": diskcache: failed to parse cached description of <%s> in %s\n", uri, path);
+		return -1;
+	}
+	cache->hits++;
+	return 1;
+}
+
+/* Store the description of a graph in the on-disk cache; @fetched and
+ * @version are the time and the graph's most recent recorded change (see
+ * spindle_db_graph_versions()) as they were before it was fetched
+ */
+int
+spindle_diskcache_store(SPINDLE *spindle, const char *uri, librdf_model *model, time_t fetched, long version)
+{
+	struct spindle_diskcache_struct *cache;
+	struct spindle_diskcache_header_struct header;
+	char path[PATH_MAX], tmp[PATH_MAX + 32], *buf, *p;
+	size_t buflen;
+	int fd, r;
+
+	if(!(cache = spindle->diskcache))
+	{
+		return 0;
+	}
+	if(spindle_diskcache_path_(cache, uri, path, sizeof(path)))
+	{
+		return 0;
+	}
+	/* Create the sub-directory, if needed */
+	p = strrchr(path, '/');
+	*p = 0;
+	if(mkdir(path, 0777) && errno != EEXIST)
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": diskcache: failed to create %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	*p = '/';
+	buflen = 0;
+	buf = twine_rdf_model_nquads(model, &buflen);
+	if(!buf && buflen)
+	{
+		return -1;
+	}
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DISKCACHE_MAGIC, sizeof(header.magic));
+	header.fetched = (uint64_t) fetched;
+	header.version = (int64_t) version;
+	header.urilen = (uint32_t) strlen(uri);
+	header.datalen = (uint32_t) buflen;
+	snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long) getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if(fd == -1)
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": diskcache: failed to open %s for writing: %s\n", tmp, strerror(errno));
+		librdf_free_memory(buf);
+		return -1;
+	}
+	r = spindle_diskcache_write_(fd, (const char *) &header, sizeof(header));
+	if(!r)
+	{
+		r = spindle_diskcache_write_(fd, uri, header.urilen);
+	}
+	if(!r && buflen)
+	{
+		r = spindle_diskcache_write_(fd, buf, buflen);
+	}
+	if(buf)
+	{
+		librdf_free_memory(buf);
+	}
+	if(close(fd))
+	{
+		r = -1;
+	}
+	if(r || rename(tmp, path))
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": diskcache: failed to write %s: %s\n", path, strerror(errno));
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+/* Remove the description of a graph from the on-disk cache */
+int
+spindle_diskcache_discard(SPINDLE *spindle, const char *uri)
+{
+	char path[PATH_MAX];
+
+	if(!spindle->diskcache)
+	{
+		return 0;
+	}
+	if(spindle_diskcache_path_(spindle->diskcache, uri, path, sizeof(path)))
+	{
+		return 0;
+	}
+	if(unlink(path) && errno != ENOENT)
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": diskcache: failed to remove %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* Determine the path of the file which holds a graph's description; the
+ * name is a 64-bit FNV-1a hash of the URI, and the first two digits select
+ * the sub-directory
+ */
+static int
+spindle_diskcache_path_(struct spindle_diskcache_struct *cache, const char *uri, char *buf, size_t bufsize)
+{
+	uint64_t h;
+	const char *s;
+	int r;
+
+	h = UINT64_C(14695981039346656037);
+	for(s = uri; *s; s++)
+	{
+		h ^= (unsigned char) *s;
+		h *= UINT64_C(1099511628211);
+	}
+	r = snprintf(buf, bufsize, "%s/%02x/%016" PRIx64, cache->path, (unsigned int) (h >> 56), h);
+	if(r < 0 || (size_t) r >= bufsize)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+/* Write a buffer in its entirety */
+static int
+spindle_diskcache_write_(int fd, const char *buf, size_t len)
+{
+	ssize_t r;
+
+	while(len)
+	{
+		r = write(fd, buf, len);
+		if(r < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+		buf += r;
+		len -= r;
+	}
+	return 0;
+}
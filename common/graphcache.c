@@ -2,7 +2,7 @@
  *
  * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
  *
- * Copyright (c) 2014-2016 BBC
+ * Copyright (c) 2014-2017 BBC
  *
  *  Licensed under the Apache License, Version 2.0 (the "License");
  *  you may not use this file except in compliance with the License.
@@ -23,6 +23,69 @@
 
 #include "p_spindle.h"
 
+/* Least-recently-used caches of the contents of source graphs, and of their
+ * self-descriptions (the statements in each graph whose subject is the graph
+ * itself), indexed by graph URI and bounded by the total number of triples
+ * held, so that a few large graphs don't repeatedly evict each other along
+ * with everything else. The most recently-fetched graph is always kept, even
+ * if it alone exceeds the budget.
+ *
+ * Descriptions are cached separately because they're needed for every
+ * source graph of every entity, while the full contents of a graph are only
+ * needed to walk its licensing data, and can be very much larger. If the
+ * on-disk cache is enabled, descriptions which aren't held in memory are
+ * looked for there before being fetched from the quad-store, and newly
+ * fetched descriptions are added to it.
+ */
+
+/* The maximum size of a prefetch query, excluding URIs */
+#define GRAPHCACHE_QUERY_SIZE           256
+
+static librdf_model *spindle_graphcache_query_(SPINDLE *spindle, const char **uristrs, size_t n, const char *pattern);
+static librdf_model *spindle_graphcache_load_(SPINDLE *spindle, const char *uri, long version);
+static struct spindle_graphcache_struct *spindle_graphcache_create_(const char *key, int defval);
+static void spindle_graphcache_destroy_(struct spindle_graphcache_struct *cache, const char *name);
+static struct spindle_graphcache_entry_struct **spindle_graphcache_slot_(struct spindle_graphcache_struct *cache, const char *uri);
+static struct spindle_graphcache_entry_struct *spindle_graphcache_find_(struct spindle_graphcache_struct *cache, const char *uri);
+static librdf_model *spindle_graphcache_add_(struct spindle_graphcache_struct *cache, const char *uri, librdf_model *model);
+static void spindle_graphcache_unlink_(struct spindle_graphcache_struct *cache, struct spindle_graphcache_entry_struct *entry);
+static void spindle_graphcache_link_(struct spindle_graphcache_struct *cache, struct spindle_graphcache_entry_struct *entry);
+static void spindle_graphcache_remove_(struct spindle_graphcache_struct *cache, struct spindle_graphcache_entry_struct *entry);
+
+/* Create the graph and graph description caches */
+int
+spindle_graphcache_init(SPINDLE *spindle)
+{
+	spindle->graphcache = spindle_graphcache_create_("spindle:graphcache-triples", SPINDLE_GRAPHCACHE_TRIPLES);
+	if(!spindle->graphcache)
+	{
+		return -1;
+	}
+	spindle->descriptions = spindle_graphcache_create_("spindle:graphdesc-triples", SPINDLE_GRAPHDESC_TRIPLES);
+	if(!spindle->descriptions)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+/* Destroy the graph and graph description caches */
+int
+spindle_graphcache_cleanup(SPINDLE *spindle)
+{
+	if(spindle->graphcache)
+	{
+		spindle_graphcache_destroy_(spindle->graphcache, "graphcache");
+		spindle->graphcache = NULL;
+	}
+	if(spindle->descriptions)
+	{
+		spindle_graphcache_destroy_(spindle->descriptions, "graphdesc");
+		spindle->descriptions = NULL;
+	}
+	return 0;
+}
+
 /* Fetch the contents of a graph identified by @graph and return a pointer to
  * it.
  *
@@ -34,43 +97,24 @@
 librdf_model *
 spindle_graphcache_fetch_node(SPINDLE *spindle, librdf_node *graph)
 {
-	size_t c;
-	librdf_uri *uri;
+	struct spindle_graphcache_entry_struct *entry;
 	librdf_model *temp;
 	const char *uristr;
 	
-	uri = librdf_node_get_uri(graph);
-	uristr = (const char *) librdf_uri_as_string(uri);
-	for(c = 0; c < SPINDLE_GRAPHCACHE_SIZE; c++)
+	uristr = (const char *) librdf_uri_as_string(librdf_node_get_uri(graph));
+	if((entry = spindle_graphcache_find_(spindle->graphcache, uristr)))
 	{
-		if(!spindle->graphcache[c].uri)
-		{
-			continue;
-		}
-		if(!strcmp(spindle->graphcache[c].uri, uristr))
-		{
-			twine_logf(LOG_DEBUG, PLUGIN_NAME ": graphcache: graph <%s> already present in graph cache\n", uristr);
-			return spindle->graphcache[c].model;
-		}
+		twine_logf(LOG_DEBUG, PLUGIN_NAME ": graphcache: graph <%s> already present in graph cache\n", uristr);
+		spindle->graphcache->hits++;
+		return entry->model;
 	}
-	for(c = 0; c < SPINDLE_GRAPHCACHE_SIZE; c++)
-	{
-		if(!spindle->graphcache[c].uri)
-		{
-			break;
-		}
-	}
-	if(c == SPINDLE_GRAPHCACHE_SIZE)
+	spindle->graphcache->misses++;
+	temp = twine_rdf_model_create();
+	if(!temp)
 	{
-		twine_rdf_model_destroy(spindle->graphcache[0].model);
-		free(spindle->graphcache[0].uri);
-		memmove(&(spindle->graphcache[0]), &(spindle->graphcache[1]),
-				sizeof(struct spindle_graphcache_struct) * (SPINDLE_GRAPHCACHE_SIZE - 1));
-		c = SPINDLE_GRAPHCACHE_SIZE - 1;
-		spindle->graphcache[c].model = NULL;
-		spindle->graphcache[c].uri = NULL;
+		return NULL;
 	}
-	temp = twine_rdf_model_create();
+	spindle_stats_sparql(spindle, 0);
 	if(sparql_queryf_model(spindle->sparql, temp,
 		"SELECT DISTINCT ?s ?p ?o\n"
 		" WHERE {\n"
@@ -83,58 +127,518 @@ spindle_graphcache_fetch_node(SPINDLE *spindle, librdf_node *graph)
 		twine_rdf_model_destroy(temp);
 		return NULL;
 	}
-	spindle->graphcache[c].model = temp;
-	spindle->graphcache[c].uri = strdup(uristr);
 	twine_logf(LOG_DEBUG, PLUGIN_NAME ": graphcache: added graph <%s> to cache\n", uristr);
-	return spindle->graphcache[c].model;
+	return spindle_graphcache_add_(spindle->graphcache, uristr, temp);
 }
 
+/* Fetch the contents of any of a list of graphs which aren't already cached
+ * with a single query, so that subsequent calls to
+ * spindle_graphcache_fetch_node() for them don't each need a round-trip. At
+ * most SPINDLE_GRAPHCACHE_PREFETCH graphs are fetched; any others are left to
+ * be fetched individually.
+ */
 int
-spindle_graphcache_discard(SPINDLE *spindle, const char *uri)
+spindle_graphcache_prefetch_graphs(SPINDLE *spindle, librdf_node **graphs, size_t count)
+{
+	const char *uristrs[SPINDLE_GRAPHCACHE_PREFETCH];
+	librdf_node *nodes[SPINDLE_GRAPHCACHE_PREFETCH];
+	librdf_model *temp, *model;
+	librdf_stream *stream;
+	const char *uristr;
+	size_t c, d, n;
+
+	for(c = 0, n = 0; c < count && n < SPINDLE_GRAPHCACHE_PREFETCH; c++)
+	{
+		uristr = (const char *) librdf_uri_as_string(librdf_node_get_uri(graphs[c]));
+		if(spindle_graphcache_find_(spindle->graphcache, uristr))
+		{
+			continue;
+		}
+		for(d = 0; d < n; d++)
+		{
+			if(!strcmp(uristrs[d], uristr))
+			{
+				break;
+			}
+		}
+		if(d < n)
+		{
+			continue;
+		}
+		uristrs[n] = uristr;
+		nodes[n] = graphs[c];
+		n++;
+	}
+	if(n < 2)
+	{
+		/* Nothing to be gained over fetching on demand */
+		return 0;
+	}
+	temp = spindle_graphcache_query_(spindle, uristrs, n,
+		"  GRAPH ?g {\n"
+		"   ?s ?p ?o .\n"
+		"  }\n");
+	if(!temp)
+	{
+		return -1;
+	}
+	/* Split the results into a cache entry per graph */
+	for(c = 0; c < n; c++)
+	{
+		model = twine_rdf_model_create();
+		if(!model)
+		{
+			twine_rdf_model_destroy(temp);
+			return -1;
+		}
+		stream = librdf_model_context_as_stream(temp, nodes[c]);
+		if(stream)
+		{
+			librdf_model_add_statements(model, stream);
+			librdf_free_stream(stream);
+		}
+		spindle->graphcache->misses++;
+		spindle_graphcache_add_(spindle->graphcache, uristrs[c], model);
+		twine_logf(LOG_DEBUG, PLUGIN_NAME ": graphcache: prefetched graph <%s>\n", uristrs[c]);
+	}
+	twine_rdf_model_destroy(temp);
+	return 0;
+}
+
+/* Fetch the descriptions of any of a list of graphs which aren't already
+ * cached with a single query, so that subsequent calls to
+ * spindle_graphcache_description_node() for them don't each need a
+ * round-trip. At most SPINDLE_GRAPHCACHE_PREFETCH graphs are fetched; any
+ * others are left to be fetched individually.
+ */
+int
+spindle_graphcache_prefetch_descriptions(SPINDLE *spindle, librdf_node **graphs, size_t count)
 {
-	size_t c;
+	const char *uristrs[SPINDLE_GRAPHCACHE_PREFETCH];
+	librdf_node *nodes[SPINDLE_GRAPHCACHE_PREFETCH];
+	long versions[SPINDLE_GRAPHCACHE_PREFETCH];
+	librdf_model *temp, *model;
+	librdf_stream *stream;
+	const char *uristr;
+	size_t c, d, n;
+	time_t fetched;
+	int store;
 
-	for(c = 0; c < SPINDLE_GRAPHCACHE_SIZE; c++)
+	for(c = 0, n = 0; c < count && n < SPINDLE_GRAPHCACHE_PREFETCH; c++)
 	{
-		if(!spindle->graphcache[c].uri)
+		uristr = (const char *) librdf_uri_as_string(librdf_node_get_uri(graphs[c]));
+		if(spindle_graphcache_find_(spindle->descriptions, uristr))
+		{
+			continue;
+		}
+		for(d = 0; d < n; d++)
+		{
+			if(!strcmp(uristrs[d], uristr))
+			{
+				break;
+			}
+		}
+		if(d < n)
 		{
 			continue;
 		}
-		if(!strcmp(spindle->graphcache[c].uri, uri))
+		uristrs[n] = uristr;
+		nodes[n] = graphs[c];
+		n++;
+	}
+	/* Descriptions can only be shared if it's known which changes to the
+	 * graphs they reflect; the changes to all of the candidates are looked
+	 * up at once, and used both to validate copies on disk and to label
+	 * those fetched below
+	 */
+	fetched = time(NULL);
+	store = (spindle->diskcache && n && !spindle_db_graph_versions(spindle, uristrs, n, versions));
+	if(store)
+	{
+		for(c = 0, d = 0; c < n; c++)
 		{
-			twine_rdf_model_destroy(spindle->graphcache[c].model);
-			free(spindle->graphcache[c].uri);
-			memset(&(spindle->graphcache[c]), 0, sizeof(struct spindle_graphcache_struct));
-			return 0;
+			if(spindle_graphcache_load_(spindle, uristrs[c], versions[c]))
+			{
+				continue;
+			}
+			uristrs[d] = uristrs[c];
+			nodes[d] = nodes[c];
+			versions[d] = versions[c];
+			d++;
 		}
+		n = d;
 	}
+	if(n < 2)
+	{
+		/* Nothing to be gained over fetching on demand */
+		return 0;
+	}
+	temp = spindle_graphcache_query_(spindle, uristrs, n,
+		"  GRAPH ?g {\n"
+		"   ?g ?p ?o .\n"
+		"  }\n"
+		"  BIND(?g AS ?s)\n");
+	if(!temp)
+	{
+		return -1;
+	}
+	/* Split the results into a cache entry per graph */
+	for(c = 0; c < n; c++)
+	{
+		model = twine_rdf_model_create();
+		if(!model)
+		{
+			twine_rdf_model_destroy(temp);
+			return -1;
+		}
+		stream = librdf_model_context_as_stream(temp, nodes[c]);
+		if(stream)
+		{
+			librdf_model_add_statements(model, stream);
+			librdf_free_stream(stream);
+		}
+		spindle->descriptions->misses++;
+		if(store)
+		{
+			spindle_diskcache_store(spindle, uristrs[c], model, fetched, versions[c]);
+		}
+		spindle_graphcache_add_(spindle->descriptions, uristrs[c], model);
+		twine_logf(LOG_DEBUG, PLUGIN_NAME ": graphcache: prefetched description of graph <%s>\n", uristrs[c]);
+	}
+	twine_rdf_model_destroy(temp);
 	return 0;
 }
 
-/* Fetch a description of a graph identified by @graph and store it in @target */
+/* Remove a graph and its description from the caches */
+int
+spindle_graphcache_discard(SPINDLE *spindle, const char *uri)
+{
+	struct spindle_graphcache_entry_struct *entry;
+
+	if(spindle->graphcache && (entry = spindle_graphcache_find_(spindle->graphcache, uri)))
+	{
+		spindle_graphcache_remove_(spindle->graphcache, entry);
+	}
+	if(spindle->descriptions && (entry = spindle_graphcache_find_(spindle->descriptions, uri)))
+	{
+		spindle_graphcache_remove_(spindle->descriptions, entry);
+	}
+	return spindle_diskcache_discard(spindle, uri);
+}
+
+/* Fetch a description of a graph identified by @graph (that is, the
+ * statements within it whose subject is @graph) and store it in @target,
+ * in the context of @graph
+ */
 int
 spindle_graphcache_description_node(SPINDLE *spindle, librdf_model *target, librdf_node *graph)
 {
+	struct spindle_graphcache_entry_struct *entry;
 	librdf_stream *stream;
 	librdf_model *model;
-	librdf_statement *query;
-	librdf_node *node;
-	
-	model = spindle_graphcache_fetch_node(spindle, graph);
+	const char *uristr;
+	time_t fetched;
+	long version;
+	int store;
+
+	uristr = (const char *) librdf_uri_as_string(librdf_node_get_uri(graph));
+	model = NULL;
+	store = 0;
+	if((entry = spindle_graphcache_find_(spindle->descriptions, uristr)))
+	{
+		spindle->descriptions->hits++;
+		model = entry->model;
+	}
+	else
+	{
+		/* The graph's most recent change both validates a copy on disk and
+		 * labels a freshly-fetched one
+		 */
+		fetched = time(NULL);
+		store = (spindle->diskcache && !spindle_db_graph_versions(spindle, &uristr, 1, &version));
+		if(store)
+		{
+			model = spindle_graphcache_load_(spindle, uristr, version);
+		}
+	}
 	if(!model)
 	{
-		return -1;
+		spindle->descriptions->misses++;
+		model = twine_rdf_model_create();
+		if(!model)
+		{
+			return -1;
+		}
+		spindle_stats_sparql(spindle, 0);
+		if(sparql_queryf_model(spindle->sparql, model,
+			"CONSTRUCT {\n"
+			"  %V ?p ?o .\n"
+			" }\n"
+			" WHERE {\n"
+			"  GRAPH %V {\n"
+			"   %V ?p ?o .\n"
+			"  }\n"
+			" }", graph, graph, graph))
+		{
+			twine_logf(LOG_ERR, PLUGIN_NAME ": graphcache: failed to fetch a graph description for <%s>\n", uristr);
+			twine_rdf_model_destroy(model);
+			return -1;
+		}
+		twine_logf(LOG_DEBUG, PLUGIN_NAME ": graphcache: added description of graph <%s> to cache\n", uristr);
+		if(store)
+		{
+			spindle_diskcache_store(spindle, uristr, model, fetched, version);
+		}
+		model = spindle_graphcache_add_(spindle->descriptions, uristr, model);
+		if(!model)
+		{
+			return -1;
+		}
+	}
+	stream = librdf_model_as_stream(model);
+	if(stream)
+	{
+		librdf_model_context_add_statements(target, graph, stream);
+		librdf_free_stream(stream);
 	}
+	return 0;
+}
 
-	query = librdf_new_statement(spindle->world);
-	node = librdf_new_node_from_node(graph);
-	librdf_statement_set_subject(query, node);
+/* Fetch the quads matching @pattern, in which ?g is bound in turn to each of
+ * the graphs in @uristrs, with a single query; @pattern MUST bind ?s, ?p, ?o
+ */
+static librdf_model *
+spindle_graphcache_query_(SPINDLE *spindle, const char **uristrs, size_t n, const char *pattern)
+{
+	librdf_model *temp;
+	char *qbuf, *p;
+	size_t c, len;
 
-	stream = librdf_model_find_statements(model, query);
-	librdf_model_context_add_statements(target, graph, stream);
-	librdf_free_stream(stream);
+	len = GRAPHCACHE_QUERY_SIZE + strlen(pattern);
+	for(c = 0; c < n; c++)
+	{
+		len += strlen(uristrs[c]) + 3;
+	}
+	qbuf = (char *) malloc(len);
+	if(!qbuf)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": graphcache: failed to allocate %lu bytes for query\n", (unsigned long) len);
+		return NULL;
+	}
+	p = qbuf;
+	p += sprintf(p, "SELECT DISTINCT ?s ?p ?o ?g\n"
+				 " WHERE {\n"
+				 "  VALUES ?g {");
+	for(c = 0; c < n; c++)
+	{
+		p += sprintf(p, " <%s>", uristrs[c]);
+	}
+	sprintf(p, " }\n%s }", pattern);
+	temp = twine_rdf_model_create();
+	if(!temp)
+	{
+		free(qbuf);
+		return NULL;
+	}
+	spindle_stats_sparql(spindle, strlen(qbuf));
+	if(sparql_query_model(spindle->sparql, qbuf, strlen(qbuf), temp))
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": graphcache: failed to fetch %lu graphs\n", (unsigned long) n);
+		free(qbuf);
+		twine_rdf_model_destroy(temp);
+		return NULL;
+	}
+	free(qbuf);
+	return temp;
+}
 
-	librdf_free_statement(query);
+/* Load the description of a graph from the on-disk cache, if enabled, into
+ * the in-memory cache, returning the cached model if successful; @version is
+ * as passed to spindle_diskcache_fetch()
+ */
+static librdf_model *
+spindle_graphcache_load_(SPINDLE *spindle, const char *uri, long version)
+{
+	librdf_model *model;
 
-	return 0;
+	if(!spindle->diskcache)
+	{
+		return NULL;
+	}
+	model = twine_rdf_model_create();
+	if(!model)
+	{
+		return NULL;
+	}
+	if(spindle_diskcache_fetch(spindle, uri, model, version) != 1)
+	{
+		twine_rdf_model_destroy(model);
+		return NULL;
+	}
+	twine_logf(LOG_DEBUG, PLUGIN_NAME ": graphcache: loaded description of graph <%s> from disk\n", uri);
+	spindle->descriptions->hits++;
+	return spindle_graphcache_add_(spindle->descriptions, uri, model);
+}
+
+/* Create an empty cache whose budget, in triples, is given by the
+ * configuration option @key
+ */
+static struct spindle_graphcache_struct *
+spindle_graphcache_create_(const char *key, int defval)
+{
+	struct spindle_graphcache_struct *cache;
+	int limit;
+
+	cache = (struct spindle_graphcache_struct *) calloc(1, sizeof(struct spindle_graphcache_struct));
+	if(!cache)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to create graph cache\n");
+		return NULL;
+	}
+	limit = twine_config_get_int(key, defval);
+	cache->limit = (limit > 0 ? (size_t) limit : 0);
+	return cache;
+}
+
+/* Log a cache's statistics, then destroy it */
+static void
+spindle_graphcache_destroy_(struct spindle_graphcache_struct *cache, const char *name)
+{
+	twine_logf(LOG_DEBUG, PLUGIN_NAME ": %s: %lu hits, %lu misses, %lu evictions\n", name, cache->hits, cache->misses, cache->evictions);
+	while(cache->head)
+	{
+		spindle_graphcache_remove_(cache, cache->head);
+	}
+	free(cache);
+}
+
+/* Locate the hash chain link which points to (or would point to) the entry
+ * for uri
+ */
+static struct spindle_graphcache_entry_struct **
+spindle_graphcache_slot_(struct spindle_graphcache_struct *cache, const char *uri)
+{
+	struct spindle_graphcache_entry_struct **slot;
+
+	slot = &(cache->buckets[spindle_strhash(uri) % SPINDLE_GRAPHCACHE_BUCKETS]);
+	while(*slot && strcmp((*slot)->uri, uri))
+	{
+		slot = &((*slot)->chain);
+	}
+	return slot;
+}
+
+/* Locate a graph in the cache, marking it as the most recently used */
+static struct spindle_graphcache_entry_struct *
+spindle_graphcache_find_(struct spindle_graphcache_struct *cache, const char *uri)
+{
+	struct spindle_graphcache_entry_struct *entry;
+
+	entry = *(spindle_graphcache_slot_(cache, uri));
+	if(entry)
+	{
+		spindle_graphcache_unlink_(cache, entry);
+		spindle_graphcache_link_(cache, entry);
+	}
+	return entry;
+}
+
+/* Add a newly-fetched graph to the cache, which takes ownership of the
+ * model, evicting the least-recently-used graphs until the cache is within
+ * its budget
+ */
+static librdf_model *
+spindle_graphcache_add_(struct spindle_graphcache_struct *cache, const char *uri, librdf_model *model)
+{
+	struct spindle_graphcache_entry_struct **slot, *entry;
+	int size;
+
+	slot = spindle_graphcache_slot_(cache, uri);
+	if(*slot)
+	{
+		spindle_graphcache_remove_(cache, *slot);
+		slot = spindle_graphcache_slot_(cache, uri);
+	}
+	entry = (struct spindle_graphcache_entry_struct *) calloc(1, sizeof(struct spindle_graphcache_entry_struct));
+	if(!entry || !(entry->uri = strdup(uri)))
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": graphcache: failed to allocate cache entry\n");
+		free(entry);
+		twine_rdf_model_destroy(model);
+		return NULL;
+	}
+	size = librdf_model_size(model);
+	entry->model = model;
+	/* Each entry is charged for one triple more than it holds, so that
+	 * empty graphs and descriptions count against the budget too
+	 */
+	entry->triples = (size > 0 ? (size_t) size : 0) + 1;
+	while(cache->head && cache->triples + entry->triples > cache->limit)
+	{
+		spindle_graphcache_remove_(cache, cache->head);
+		cache->evictions++;
+	}
+	slot = spindle_graphcache_slot_(cache, uri);
+	*slot = entry;
+	cache->triples += entry->triples;
+	cache->count++;
+	spindle_graphcache_link_(cache, entry);
+	return model;
+}
+
+/* Remove an entry from the LRU list */
+static void
+spindle_graphcache_unlink_(struct spindle_graphcache_struct *cache, struct spindle_graphcache_entry_struct *entry)
+{
+	if(entry->prev)
+	{
+		entry->prev->next = entry->next;
+	}
+	else
+	{
+		cache->head = entry->next;
+	}
+	if(entry->next)
+	{
+		entry->next->prev = entry->prev;
+	}
+	else
+	{
+		cache->tail = entry->prev;
+	}
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+/* Add an entry to the most-recently-used end of the LRU list */
+static void
+spindle_graphcache_link_(struct spindle_graphcache_struct *cache, struct spindle_graphcache_entry_struct *entry)
+{
+	entry->prev = cache->tail;
+	entry->next = NULL;
+	if(cache->tail)
+	{
+		cache->tail->next = entry;
+	}
+	else
+	{
+		cache->head = entry;
+	}
+	cache->tail = entry;
+}
+
+/* Remove an entry from the cache altogether and free it */
+static void
+spindle_graphcache_remove_(struct spindle_graphcache_struct *cache, struct spindle_graphcache_entry_struct *entry)
+{
+	struct spindle_graphcache_entry_struct **slot;
+
+	slot = spindle_graphcache_slot_(cache, entry->uri);
+	*slot = entry->chain;
+	spindle_graphcache_unlink_(cache, entry);
+	cache->count--;
+	cache->triples -= entry->triples;
+	twine_rdf_model_destroy(entry->model);
+	free(entry->uri);
+	free(entry);
 }
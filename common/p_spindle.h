@@ -21,14 +21,19 @@
 # define P_SPINDLE_H_                   1
 
 # include <stdio.h>
+# include <stdarg.h>
 # include <stdlib.h>
 # include <string.h>
 # include <unistd.h>
+# include <fcntl.h>
+# include <sys/mman.h>
 # include <sys/stat.h>
 # include <sys/types.h>
 # include <inttypes.h>
 # include <ctype.h>
 # include <errno.h>
+# include <time.h>
+# include <limits.h>
 # include <uuid/uuid.h>
 
 # include "spindle-common.h"
@@ -39,8 +44,189 @@
 /* The number of co-references allocated at a time when extending a set */
 # define SET_BLOCKSIZE                  4
 
-/* The number of entries in the graph cache */
-# define SPINDLE_GRAPHCACHE_SIZE        16
+/* The size of the first arena block allocated for a string-set's strings */
+# define STRSET_BLOCKSIZE               256
+
+/* The number of entries a string-set must have before it is hash-indexed */
+# define STRSET_HASHMIN                 8
+
+/* The default maximum number of triples held in the graph and graph
+ * description caches, the number of hash buckets used to index each, and the
+ * maximum number of graph descriptions fetched by a single prefetch query
+ */
+# define SPINDLE_GRAPHCACHE_TRIPLES     250000
+# define SPINDLE_GRAPHDESC_TRIPLES      20000
+# define SPINDLE_GRAPHCACHE_BUCKETS     61
+# define SPINDLE_GRAPHCACHE_PREFETCH    16
+
+/* The default lifetime of an entry in the on-disk graph description cache,
+ * in seconds
+ */
+# define SPINDLE_DISKCACHE_TTL          3600
+
+/* The default maximum number of entries in the proxy cache, and the
+ * default lifetime of an entry, in seconds
+ */
+# define SPINDLE_PROXYCACHE_SIZE        4096
+# define SPINDLE_PROXYCACHE_TTL         300
+
+/* The number of finite buckets in a latency histogram */
+# define SPINDLE_STATS_BUCKETS          13
+
+/* A latency histogram; times are in microseconds */
+struct spindle_histogram_struct
+{
+	unsigned long count;
+	unsigned long long sum;
+	unsigned long buckets[SPINDLE_STATS_BUCKETS];
+};
+
+/* Process-wide statistics */
+struct spindle_stats_struct
+{
+	char *path;
+	int interval;
+	time_t started;
+	time_t flushed;
+	struct spindle_histogram_struct stages[SPINDLE_STAGE_COUNT];
+	unsigned long entities;
+	unsigned long failures;
+	unsigned long sqlqueries;
+	unsigned long long sqlbytes;
+	unsigned long sparqlqueries;
+	unsigned long long sparqlbytes;
+};
+
+/* The maximum number of distinct query templates tracked, the size of the
+ * template hash table, and the maximum length of a template
+ */
+# define SPINDLE_QUERYSTATS_MAX         256
+# define SPINDLE_QUERYSTATS_BUCKETS     127
+# define SPINDLE_QUERYSTATS_LEN         240
+
+/* Statistics about a single query template; times are in microseconds */
+struct spindle_querystats_entry_struct
+{
+	char *template;
+	unsigned long calls;
+	/* The number of calls which were timed, and their total and maximum */
+	unsigned long timed;
+	unsigned long long usec;
+	unsigned long long maxusec;
+	/* The number of calls whose row counts were reported, and their sum */
+	unsigned long rowcalls;
+	unsigned long long rows;
+	unsigned long errors;
+	unsigned long deadlocks;
+	unsigned long retries;
+	/* The next entry in the same hash bucket */
+	struct spindle_querystats_entry_struct *chain;
+};
+
+/* Per-template SQL statistics */
+struct spindle_querystats_struct
+{
+	struct spindle_querystats_entry_struct *buckets[SPINDLE_QUERYSTATS_BUCKETS];
+	struct spindle_querystats_entry_struct *entries[SPINDLE_QUERYSTATS_MAX];
+	size_t count;
+	/* Used if an entry can't be allocated */
+	struct spindle_querystats_entry_struct fallback;
+	/* The statement being timed, when it began, the most recent statement,
+	 * and the statement whose failure caused the current attempt at a
+	 * transaction to fail
+	 */
+	struct spindle_querystats_entry_struct *current;
+	unsigned long long started;
+	struct spindle_querystats_entry_struct *last;
+	struct spindle_querystats_entry_struct *failed;
+	/* How often, in seconds, to report, and how many templates to include */
+	int interval;
+	int top;
+	time_t dumped;
+};
+
+/* A block of string storage belonging to a string-set */
+struct spindle_strset_block_struct
+{
+	struct spindle_strset_block_struct *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+/* The cached contents of a source graph */
+struct spindle_graphcache_entry_struct
+{
+	char *uri;
+	librdf_model *model;
+	size_t triples;
+	/* The next entry in the same hash bucket */
+	struct spindle_graphcache_entry_struct *chain;
+	/* Neighbours in least-recently-used order */
+	struct spindle_graphcache_entry_struct *prev;
+	struct spindle_graphcache_entry_struct *next;
+};
+
+/* The graph cache: a hash table threaded with a least-recently-used list */
+struct spindle_graphcache_struct
+{
+	struct spindle_graphcache_entry_struct *buckets[SPINDLE_GRAPHCACHE_BUCKETS];
+	struct spindle_graphcache_entry_struct *head;
+	struct spindle_graphcache_entry_struct *tail;
+	size_t count;
+	size_t triples;
+	size_t limit;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+};
+
+/* The on-disk graph description cache */
+struct spindle_diskcache_struct
+{
+	char *path;
+	int ttl;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long expired;
+	unsigned long stale;
+};
+
+/* A cached mapping from an external URI to its proxy (if any) */
+struct spindle_proxycache_entry_struct
+{
+	char *uri;
+	char *localname;
+	time_t expires;
+	/* The next entry in the same hash bucket */
+	struct spindle_proxycache_entry_struct *chain;
+	/* Neighbours in least-recently-used order */
+	struct spindle_proxycache_entry_struct *prev;
+	struct spindle_proxycache_entry_struct *next;
+};
+
+/* The proxy cache: a hash table threaded with a least-recently-used list */
+struct spindle_proxycache_struct
+{
+	struct spindle_proxycache_entry_struct **buckets;
+	size_t nbuckets;
+	struct spindle_proxycache_entry_struct *head;
+	struct spindle_proxycache_entry_struct *tail;
+	size_t count;
+	size_t limit;
+	int ttl;
+	unsigned long hits;
+	unsigned long misses;
+};
+
+/* An external URI whose proxy is being looked up as part of a batch, and
+ * where to store the result; batches are sorted by URI
+ */
+struct spindle_locate_struct
+{
+	const char *uri;
+	char **dest;
+};
 
 /* Internal rule-base processing */
 int spindle_rulebase_class_add_node(SPINDLERULES *rules, librdf_model *model, const char *uri, librdf_node *node);
@@ -63,12 +249,51 @@ int spindle_rulebase_cachepred_dump(SPINDLERULES *rules);
 int spindle_rulebase_coref_add_node(SPINDLERULES *rules, const char *predicate, librdf_node *node);
 int spindle_rulebase_coref_dump(SPINDLERULES *rules);
 
+/* Graph cache */
+int spindle_graphcache_init(SPINDLE *spindle);
+int spindle_graphcache_cleanup(SPINDLE *spindle);
+
+/* On-disk graph description cache */
+int spindle_diskcache_init(SPINDLE *spindle);
+int spindle_diskcache_cleanup(SPINDLE *spindle);
+int spindle_diskcache_fetch(SPINDLE *spindle, const char *uri, librdf_model *model, long version);
+int spindle_diskcache_store(SPINDLE *spindle, const char *uri, librdf_model *model, time_t fetched, long version);
+int spindle_diskcache_discard(SPINDLE *spindle, const char *uri);
+
+/* Proxy cache (used in the absence of an RDBMS) */
+int spindle_proxycache_init(SPINDLE *spindle);
+int spindle_proxycache_cleanup(SPINDLE *spindle);
+int spindle_proxycache_get(SPINDLE *spindle, const char *uri, char **localname);
+int spindle_proxycache_set(SPINDLE *spindle, const char *uri, const char *localname);
+int spindle_proxycache_move(SPINDLE *spindle, const char *from, const char *to);
+
+/* Statistics collection */
+int spindle_stats_init(SPINDLE *spindle);
+int spindle_stats_cleanup(SPINDLE *spindle);
+
+/* SQL query statistics */
+int spindle_querystats_init(SPINDLE *spindle);
+int spindle_querystats_cleanup(SPINDLE *spindle);
+void spindle_querystats_reset(SPINDLE *spindle);
+void spindle_querystats_start(SPINDLE *spindle);
+void spindle_querystats_begin(SPINDLE *spindle, const char *query);
+void spindle_querystats_end(SPINDLE *spindle);
+void spindle_querystats_error(SPINDLE *spindle, const char *sqlstate);
+void spindle_querystats_attempt(SPINDLE *spindle);
+void spindle_querystats_retry(SPINDLE *spindle);
+int spindle_querystats_dump(SPINDLE *spindle, int force);
+
+/* Batched proxy lookups */
+int spindle_proxy_locate_found(struct spindle_locate_struct *list, size_t count, const char *uri, const char *localname);
+
 /* Database schema update */
 int spindle_db_schema_update_(SPINDLE *spindle);
 
 /* RDBMS-based correlation */
 int spindle_db_proxy_create(SPINDLE *spindle, const char *uri1, const char *uri2, struct spindle_strset_struct *changeset);
+int spindle_db_proxy_create_set(SPINDLE *spindle, struct spindle_corefset_struct *corefs, struct spindle_strset_struct *changeset);
 char *spindle_db_proxy_locate(SPINDLE *spindle, const char *uri);
+int spindle_db_proxy_locate_many(SPINDLE *spindle, struct spindle_locate_struct *list, size_t count);
 int spindle_db_proxy_relate(SPINDLE *spindle, const char *remote, const char *local);
 char **spindle_db_proxy_refs(SPINDLE *spindle, const char *uri);
 int spindle_db_proxy_migrate(SPINDLE *spindle, const char *from, const char *to, char **refs);
@@ -0,0 +1,295 @@
+/* Spindle: Co-reference aggregation engine
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2016 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_spindle.h"
+
+/* A bounded, least-recently-used cache of external URI to local proxy URI
+ * mappings, used when there is no relational database and every lookup
+ * would otherwise be a SPARQL query.
+ *
+ * Entries with a NULL localname record that the URI has no proxy (negative
+ * caching). Entries expire after a configurable period, so that mappings
+ * created by other processes are eventually seen; changes made by this
+ * process are applied to the cache directly.
+ */
+
+static struct spindle_proxycache_entry_struct **spindle_proxycache_slot_(struct spindle_proxycache_struct *cache, const char *uri);
+static void spindle_proxycache_unlink_(struct spindle_proxycache_struct *cache, struct spindle_proxycache_entry_struct *entry);
+static void spindle_proxycache_link_(struct spindle_proxycache_struct *cache, struct spindle_proxycache_entry_struct *entry);
+static void spindle_proxycache_remove_(struct spindle_proxycache_struct *cache, struct spindle_proxycache_entry_struct *entry);
+
+/* Create the proxy cache, if enabled and there is no database */
+int
+spindle_proxycache_init(SPINDLE *spindle)
+{
+	struct spindle_proxycache_struct *cache;
+	int limit, ttl;
+
+	if(spindle->db)
+	{
+		return 0;
+	}
+	limit = twine_config_get_int("spindle:proxycache-size", SPINDLE_PROXYCACHE_SIZE);
+	ttl = twine_config_get_int("spindle:proxycache-ttl", SPINDLE_PROXYCACHE_TTL);
+	if(limit <= 0 || ttl <= 0)
+	{
+		return 0;
+	}
+	cache = (struct spindle_proxycache_struct *) calloc(1, sizeof(struct spindle_proxycache_struct));
+	if(!cache)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to create proxy cache\n");
+		return -1;
+	}
+	cache->limit = (size_t) limit;
+	cache->ttl = ttl;
+	/* Keep the load factor at or below one */
+	for(cache->nbuckets = 16; cache->nbuckets < cache->limit; cache->nbuckets <<= 1);
+	cache->buckets = (struct spindle_proxycache_entry_struct **) calloc(cache->nbuckets, sizeof(struct spindle_proxycache_entry_struct *));
+	if(!cache->buckets)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate proxy cache index\n");
+		free(cache);
+		return -1;
+	}
+	spindle->proxycache = cache;
+	return 0;
+}
+
+/* Destroy the proxy cache */
+int
+spindle_proxycache_cleanup(SPINDLE *spindle)
+{
+	struct spindle_proxycache_struct *cache;
+
+	if(!(cache = spindle->proxycache))
+	{
+		return 0;
+	}
+	twine_logf(LOG_DEBUG, PLUGIN_NAME ": proxycache: %lu hits, %lu misses\n", cache->hits, cache->misses);
+	while(cache->head)
+	{
+		spindle_proxycache_remove_(cache, cache->head);
+	}
+	free(cache->buckets);
+	free(cache);
+	spindle->proxycache = NULL;
+	return 0;
+}
+
+/* Look up an external URI in the cache: returns 1 and sets *localname (to a
+ * newly-allocated string, or NULL if the URI is known to have no proxy) if
+ * the URI was found, 0 if it wasn't, or -1 on error
+ */
+int
+spindle_proxycache_get(SPINDLE *spindle, const char *uri, char **localname)
+{
+	struct spindle_proxycache_struct *cache;
+	struct spindle_proxycache_entry_struct *entry;
+
+	*localname = NULL;
+	if(!(cache = spindle->proxycache))
+	{
+		return 0;
+	}
+	entry = *(spindle_proxycache_slot_(cache, uri));
+	if(!entry)
+	{
+		cache->misses++;
+		return 0;
+	}
+	if(entry->expires <= time(NULL))
+	{
+		spindle_proxycache_remove_(cache, entry);
+		cache->misses++;
+		return 0;
+	}
+	cache->hits++;
+	/* Move the entry to the most-recently-used end of the list */
+	spindle_proxycache_unlink_(cache, entry);
+	spindle_proxycache_link_(cache, entry);
+	if(entry->localname)
+	{
+		*localname = strdup(entry->localname);
+		if(!*localname)
+		{
+			twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to duplicate cached proxy URI\n");
+			return -1;
+		}
+	}
+	return 1;
+}
+
+/* Record the proxy for an external URI (or that it has none, if localname
+ * is NULL), evicting the least-recently-used entry if the cache is full
+ */
+int
+spindle_proxycache_set(SPINDLE *spindle, const char *uri, const char *localname)
+{
+	struct spindle_proxycache_struct *cache;
+	struct spindle_proxycache_entry_struct **slot, *entry;
+	char *p;
+
+	if(!(cache = spindle->proxycache))
+	{
+		return 0;
+	}
+	p = NULL;
+	if(localname && !(p = strdup(localname)))
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to duplicate proxy URI\n");
+		return -1;
+	}
+	slot = spindle_proxycache_slot_(cache, uri);
+	if((entry = *slot))
+	{
+		free(entry->localname);
+		spindle_proxycache_unlink_(cache, entry);
+	}
+	else
+	{
+		if(cache->count >= cache->limit)
+		{
+			spindle_proxycache_remove_(cache, cache->head);
+			slot = spindle_proxycache_slot_(cache, uri);
+		}
+		entry = (struct spindle_proxycache_entry_struct *) calloc(1, sizeof(struct spindle_proxycache_entry_struct));
+		if(!entry || !(entry->uri = strdup(uri)))
+		{
+			twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate proxy cache entry\n");
+			free(entry);
+			free(p);
+			return -1;
+		}
+		*slot = entry;
+		cache->count++;
+	}
+	entry->localname = p;
+	entry->expires = time(NULL) + cache->ttl;
+	spindle_proxycache_link_(cache, entry);
+	return 0;
+}
+
+/* Re-point every cached mapping to the proxy 'from' at 'to' (or discard
+ * them, if 'to' is NULL), following a migration
+ */
+int
+spindle_proxycache_move(SPINDLE *spindle, const char *from, const char *to)
+{
+	struct spindle_proxycache_struct *cache;
+	struct spindle_proxycache_entry_struct *entry, *next;
+	char *p;
+
+	if(!(cache = spindle->proxycache))
+	{
+		return 0;
+	}
+	for(entry = cache->head; entry; entry = next)
+	{
+		next = entry->next;
+		if(!entry->localname || strcmp(entry->localname, from))
+		{
+			continue;
+		}
+		if(!to || !(p = strdup(to)))
+		{
+			spindle_proxycache_remove_(cache, entry);
+			continue;
+		}
+		free(entry->localname);
+		entry->localname = p;
+	}
+	return 0;
+}
+
+/* Locate the hash chain link which points to (or would point to) the entry
+ * for uri
+ */
+static struct spindle_proxycache_entry_struct **
+spindle_proxycache_slot_(struct spindle_proxycache_struct *cache, const char *uri)
+{
+	struct spindle_proxycache_entry_struct **slot;
+
+	slot = &(cache->buckets[spindle_strhash(uri) & (cache->nbuckets - 1)]);
+	while(*slot && strcmp((*slot)->uri, uri))
+	{
+		slot = &((*slot)->chain);
+	}
+	return slot;
+}
+
+/* Remove an entry from the LRU list */
+static void
+spindle_proxycache_unlink_(struct spindle_proxycache_struct *cache, struct spindle_proxycache_entry_struct *entry)
+{
+	if(entry->prev)
+	{
+		entry->prev->next = entry->next;
+	}
+	else
+	{
+		cache->head = entry->next;
+	}
+	if(entry->next)
+	{
+		entry->next->prev = entry->prev;
+	}
+	else
+	{
+		cache->tail = entry->prev;
+	}
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+/* Add an entry to the most-recently-used end of the LRU list */
+static void
+spindle_proxycache_link_(struct spindle_proxycache_struct *cache, struct spindle_proxycache_entry_struct *entry)
+{
+	entry->prev = cache->tail;
+	entry->next = NULL;
+	if(cache->tail)
+	{
+		cache->tail->next = entry;
+	}
+	else
+	{
+		cache->head = entry;
+	}
+	cache->tail = entry;
+}
+
+/* Remove an entry from the cache altogether and free it */
+static void
+spindle_proxycache_remove_(struct spindle_proxycache_struct *cache, struct spindle_proxycache_entry_struct *entry)
+{
+	struct spindle_proxycache_entry_struct **slot;
+
+	slot = spindle_proxycache_slot_(cache, entry->uri);
+	*slot = entry->chain;
+	spindle_proxycache_unlink_(cache, entry);
+	cache->count--;
+	free(entry->uri);
+	free(entry->localname);
+	free(entry);
+}
@@ -0,0 +1,433 @@
+/* Spindle: Co-reference aggregation engine
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_spindle.h"
+
+/* Per-query-template SQL statistics.
+ *
+ * Each statement is reduced to a template by replacing literals with
+ * placeholders. libsql's query and error log hooks count the calls to and
+ * errors in each template, while latency is measured around the statement
+ * itself by spindle_db_queryf() and spindle_db_executef(), so that it doesn't
+ * include the time spent by the caller processing the results. Deadlocks and
+ * transaction retries are attributed to the template of the statement which
+ * failed.
+ */
+
+static struct spindle_querystats_entry_struct *spindle_querystats_entry_(struct spindle_querystats_struct *qs, const char *template);
+static void spindle_querystats_normalise_(const char *query, char *buf, size_t bufsize);
+static int spindle_querystats_compare_(const void *a, const void *b);
+
+/* Create the query statistics table, if enabled */
+int
+spindle_querystats_init(SPINDLE *spindle)
+{
+	struct spindle_querystats_struct *qs;
+	int interval;
+
+	interval = twine_config_get_int("spindle:querystats-interval", 0);
+	if(interval <= 0)
+	{
+		return 0;
+	}
+	qs = (struct spindle_querystats_struct *) calloc(1, sizeof(struct spindle_querystats_struct));
+	if(!qs)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate query statistics\n");
+		return -1;
+	}
+	qs->interval = interval;
+	qs->top = twine_config_get_int("spindle:querystats-top", 20);
+	qs->dumped = time(NULL);
+	spindle->querystats = qs;
+	return 0;
+}
+
+/* Report and destroy the query statistics */
+int
+spindle_querystats_cleanup(SPINDLE *spindle)
+{
+	struct spindle_querystats_struct *qs;
+	size_t c;
+
+	if(!(qs = spindle->querystats))
+	{
+		return 0;
+	}
+	spindle_querystats_dump(spindle, 1);
+	for(c = 0; c < qs->count; c++)
+	{
+		free(qs->entries[c]->template);
+		free(qs->entries[c]);
+	}
+	free(qs);
+	spindle->querystats = NULL;
+	return 0;
+}
+
+/* Discard the statistics gathered so far, if enabled */
+void
+spindle_querystats_reset(SPINDLE *spindle)
+{
+	struct spindle_querystats_struct *qs;
+	size_t c;
+
+	if(!(qs = spindle->querystats))
+	{
+		return;
+	}
+	for(c = 0; c < qs->count; c++)
+	{
+		free(qs->entries[c]->template);
+		free(qs->entries[c]);
+	}
+	memset(qs->buckets, 0, sizeof(qs->buckets));
+	memset(&(qs->fallback), 0, sizeof(qs->fallback));
+	qs->count = 0;
+	qs->current = NULL;
+	qs->last = NULL;
+	qs->failed = NULL;
+	qs->dumped = time(NULL);
+}
+
+/* Note that a statement is about to be timed; called before it is issued */
+void
+spindle_querystats_start(SPINDLE *spindle)
+{
+	struct spindle_querystats_struct *qs;
+
+	if(!(qs = spindle->querystats))
+	{
+		return;
+	}
+	qs->current = NULL;
+	qs->started = spindle_stats_clock();
+}
+
+/* Note that a statement has been issued (from the query log hook) */
+void
+spindle_querystats_begin(SPINDLE *spindle, const char *query)
+{
+	struct spindle_querystats_struct *qs;
+	char template[SPINDLE_QUERYSTATS_LEN];
+
+	if(!(qs = spindle->querystats))
+	{
+		return;
+	}
+	spindle_querystats_normalise_(query, template, sizeof(template));
+	qs->current = spindle_querystats_entry_(qs, template);
+	qs->last = qs->current;
+	qs->current->calls++;
+}
+
+/* Note that the statement being timed has completed, attributing the time
+ * since spindle_querystats_start() to it
+ */
+void
+spindle_querystats_end(SPINDLE *spindle)
+{
+	struct spindle_querystats_struct *qs;
+	unsigned long long usec;
+
+	if(!(qs = spindle->querystats))
+	{
+		return;
+	}
+	if(qs->current)
+	{
+		usec = spindle_stats_clock() - qs->started;
+		qs->current->usec += usec;
+		qs->current->timed++;
+		if(usec > qs->current->maxusec)
+		{
+			qs->current->maxusec = usec;
+		}
+		qs->current = NULL;
+	}
+	spindle_querystats_dump(spindle, 0);
+}
+
+/* Record the number of rows returned or affected by the most recent
+ * statement
+ */
+void
+spindle_querystats_rows(SPINDLE *spindle, long rows)
+{
+	struct spindle_querystats_struct *qs;
+
+	if(!(qs = spindle->querystats) || !qs->last || rows < 0)
+	{
+		return;
+	}
+	qs->last->rowcalls++;
+	qs->last->rows += rows;
+}
+
+/* Record that the most recent statement failed */
+void
+spindle_querystats_error(SPINDLE *spindle, const char *sqlstate)
+{
+	struct spindle_querystats_struct *qs;
+
+	if(!(qs = spindle->querystats) || !qs->last)
+	{
+		return;
+	}
+	qs->last->errors++;
+	if(sqlstate && !strcmp(sqlstate, "40P01"))
+	{
+		qs->last->deadlocks++;
+	}
+	/* Only a serialisation failure or deadlock (class 40) will cause a
+	 * transaction to be retried
+	 */
+	if(sqlstate && !strncmp(sqlstate, "40", 2))
+	{
+		qs->failed = qs->last;
+	}
+}
+
+/* Note that an attempt at a transaction is beginning */
+void
+spindle_querystats_attempt(SPINDLE *spindle)
+{
+	struct spindle_querystats_struct *qs;
+
+	if(!(qs = spindle->querystats))
+	{
+		return;
+	}
+	qs->failed = NULL;
+}
+
+/* Record that an attempt at a transaction has failed. It is counted as a
+ * retry of the statement responsible only if one of its statements failed
+ * in a way which causes the transaction to be retried; failures of anything
+ * else, such as SPARQL requests, are not SQL retries.
+ */
+void
+spindle_querystats_retry(SPINDLE *spindle)
+{
+	struct spindle_querystats_struct *qs;
+
+	if(!(qs = spindle->querystats))
+	{
+		return;
+	}
+	if(qs->failed)
+	{
+		qs->failed->retries++;
+		qs->failed = NULL;
+	}
+}
+
+/* Log the templates which have accounted for the most time, if the
+ * reporting interval has elapsed, or unconditionally if force is set
+ */
+int
+spindle_querystats_dump(SPINDLE *spindle, int force)
+{
+	struct spindle_querystats_struct *qs;
+	struct spindle_querystats_entry_struct **sorted, *entry;
+	time_t now;
+	size_t c, top;
+
+	if(!(qs = spindle->querystats))
+	{
+		return 0;
+	}
+	now = time(NULL);
+	if(!force && now - qs->dumped < qs->interval)
+	{
+		return 0;
+	}
+	qs->dumped = now;
+	if(!qs->count)
+	{
+		return 0;
+	}
+	sorted = (struct spindle_querystats_entry_struct **) malloc(sizeof(struct spindle_querystats_entry_struct *) * qs->count);
+	if(!sorted)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate memory for query statistics report\n");
+		return -1;
+	}
+	memcpy(sorted, qs->entries, sizeof(struct spindle_querystats_entry_struct *) * qs->count);
+	qsort(sorted, qs->count, sizeof(struct spindle_querystats_entry_struct *), spindle_querystats_compare_);
+	top = (qs->top > 0 && (size_t) qs->top < qs->count ? (size_t) qs->top : qs->count);
+	twine_logf(LOG_NOTICE, PLUGIN_NAME ": querystats: top %lu of %lu query templates by total time:\n", (unsigned long) top, (unsigned long) qs->count);
+	for(c = 0; c < top; c++)
+	{
+		entry = sorted[c];
+		twine_logf(LOG_NOTICE, PLUGIN_NAME ": querystats: %2lu. %lu calls, %.1fms total, %.2fms mean, %.1fms max, %.1f rows mean, %lu errors, %lu deadlocks, %lu retries: %s\n",
+				   (unsigned long) c + 1, entry->calls,
+				   (double) entry->usec / 1000.0,
+				   (entry->timed ? (double) entry->usec / 1000.0 / (double) entry->timed : 0.0),
+				   (double) entry->maxusec / 1000.0,
+				   (entry->rowcalls ? (double) entry->rows / (double) entry->rowcalls : 0.0),
+				   entry->errors, entry->deadlocks, entry->retries, entry->template);
+	}
+	free(sorted);
+	return 0;
+}
+
+/* Find or create the entry for a template; once the table is full, any new
+ * templates are accounted to a catch-all entry
+ */
+static struct spindle_querystats_entry_struct *
+spindle_querystats_entry_(struct spindle_querystats_struct *qs, const char *template)
+{
+	struct spindle_querystats_entry_struct **slot, *entry;
+
+	slot = &(qs->buckets[spindle_strhash(template) % SPINDLE_QUERYSTATS_BUCKETS]);
+	while(*slot && strcmp((*slot)->template, template))
+	{
+		slot = &((*slot)->chain);
+	}
+	if(*slot)
+	{
+		return *slot;
+	}
+	if(qs->count >= SPINDLE_QUERYSTATS_MAX - 1)
+	{
+		if(strcmp(template, "(other)"))
+		{
+			return spindle_querystats_entry_(qs, "(other)");
+		}
+	}
+	entry = (struct spindle_querystats_entry_struct *) calloc(1, sizeof(struct spindle_querystats_entry_struct));
+	if(!entry || !(entry->template = strdup(template)))
+	{
+		/* Statistics are best-effort; account to the most recent entry */
+		free(entry);
+		return (qs->count ? qs->entries[qs->count - 1] : &(qs->fallback));
+	}
+	*slot = entry;
+	qs->entries[qs->count] = entry;
+	qs->count++;
+	return entry;
+}
+
+/* Reduce a statement to a template: string and numeric literals are replaced
+ * with '?', lists of placeholders are collapsed into one, and runs of
+ * whitespace are collapsed into a single space
+ */
+static void
+spindle_querystats_normalise_(const char *query, char *buf, size_t bufsize)
+{
+	const char *s;
+	size_t len;
+
+	len = 0;
+	for(s = query; *s && len < bufsize - 1; s++)
+	{
+		if(*s == '\'' || (isdigit((unsigned char) *s) && (!len || (!isalnum((unsigned char) buf[len - 1]) && buf[len - 1] != '_'))))
+		{
+			if(*s == '\'')
+			{
+				/* Skip to the closing quote; doubled quotes are escapes */
+				for(s++; *s && !(s[0] == '\'' && s[1] != '\''); s += (*s == '\'' ? 2 : 1));
+			}
+			else
+			{
+				while(isdigit((unsigned char) s[1]) || s[1] == '.')
+				{
+					s++;
+				}
+			}
+			/* Collapse "?, ?" into "?" */
+			if(len >= 3 && !strncmp(&(buf[len - 3]), "?, ", 3))
+			{
+				len -= 2;
+			}
+			else if(len >= 2 && !strncmp(&(buf[len - 2]), "?,", 2))
+			{
+				len--;
+			}
+			else
+			{
+				buf[len] = '?';
+				len++;
+			}
+			if(!*s)
+			{
+				break;
+			}
+		}
+		else if(*s == '"')
+		{
+			/* Copy quoted identifiers verbatim */
+			do
+			{
+				buf[len] = *s;
+				len++;
+				s++;
+			}
+			while(*s && *s != '"' && len < bufsize - 2);
+			if(!*s)
+			{
+				break;
+			}
+			buf[len] = *s;
+			len++;
+		}
+		else if(isspace((unsigned char) *s))
+		{
+			if(len && buf[len - 1] != ' ')
+			{
+				buf[len] = ' ';
+				len++;
+			}
+		}
+		else
+		{
+			buf[len] = *s;
+			len++;
+		}
+	}
+	while(len && buf[len - 1] == ' ')
+	{
+		len--;
+	}
+	buf[len] = 0;
+}
+
+/* Order templates by total time, descending */
+static int
+spindle_querystats_compare_(const void *a, const void *b)
+{
+	const struct spindle_querystats_entry_struct *ea, *eb;
+
+	ea = *((const struct spindle_querystats_entry_struct **) a);
+	eb = *((const struct spindle_querystats_entry_struct **) b);
+	if(ea->usec > eb->usec)
+	{
+		return -1;
+	}
+	if(ea->usec < eb->usec)
+	{
+		return 1;
+	}
+	return strcmp(ea->template, eb->template);
+}
@@ -24,6 +24,7 @@
 #include "p_spindle.h"
 
 static int spindle_rulebase_pred_compare_(const void *ptra, const void *ptrb);
+static int spindle_rulebase_pred_index_compare_(const void *ptra, const void *ptrb);
 static struct spindle_predicatemap_struct *spindle_rulebase_pred_add_(SPINDLERULES *rules, const char *preduri);
 static int spindle_rulebase_pred_add_match_(struct spindle_predicatemap_struct *map, const char *matchuri, const char *classuri, int score, int prominence, int inverse);
 static int spindle_rulebase_pred_set_score_(struct spindle_predicatemap_struct *map, librdf_statement *statement);
@@ -242,10 +243,90 @@ spindle_rulebase_pred_add_matchnode(SPINDLERULES *rules, librdf_model *model, co
 int
 spindle_rulebase_pred_finalise(SPINDLERULES *rules)
 {
+	size_t c, d, n, mask;
+
 	qsort(rules->predicates, rules->predcount, sizeof(struct spindle_predicatemap_struct), spindle_rulebase_pred_compare_);
+	/* Build the index of source predicates, so that each statement being
+	 * processed only needs to be tested against the matches for its own
+	 * predicate
+	 */
+	free(rules->predindex);
+	free(rules->predhash);
+	rules->predindex = NULL;
+	rules->predhash = NULL;
+	rules->predindexcount = 0;
+	rules->predhashsize = 0;
+	for(c = n = 0; c < rules->predcount; c++)
+	{
+		n += rules->predicates[c].matchcount;
+	}
+	if(!n)
+	{
+		return 0;
+	}
+	rules->predindex = (struct spindle_predicateindex_struct *) calloc(n, sizeof(struct spindle_predicateindex_struct));
+	for(rules->predhashsize = 16; rules->predhashsize < n * 2; rules->predhashsize *= 2);
+	rules->predhash = (size_t *) calloc(rules->predhashsize, sizeof(size_t));
+	if(!rules->predindex || !rules->predhash)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate predicate index\n");
+		return -1;
+	}
+	for(c = 0; c < rules->predcount; c++)
+	{
+		for(d = 0; d < rules->predicates[c].matchcount; d++)
+		{
+			rules->predindex[rules->predindexcount].predicate = rules->predicates[c].matches[d].predicate;
+			rules->predindex[rules->predindexcount].map = c;
+			rules->predindex[rules->predindexcount].match = d;
+			rules->predindexcount++;
+		}
+	}
+	qsort(rules->predindex, rules->predindexcount, sizeof(struct spindle_predicateindex_struct), spindle_rulebase_pred_index_compare_);
+	mask = rules->predhashsize - 1;
+	for(n = 0; n < rules->predindexcount; n++)
+	{
+		if(n && !strcmp(rules->predindex[n].predicate, rules->predindex[n - 1].predicate))
+		{
+			continue;
+		}
+		for(c = spindle_strhash(rules->predindex[n].predicate) & mask; rules->predhash[c]; c = (c + 1) & mask);
+		rules->predhash[c] = n + 1;
+	}
 	return 0;
 }
 
+/* Find the predicate index entries matching a source predicate URI; the
+ * entries are ordered by predicate map and then by match
+ */
+const struct spindle_predicateindex_struct *
+spindle_rulebase_pred_lookup(SPINDLERULES *rules, const char *predicate, size_t *count)
+{
+	const struct spindle_predicateindex_struct *entry;
+	size_t c, n, mask;
+
+	*count = 0;
+	if(!rules->predhashsize)
+	{
+		return NULL;
+	}
+	mask = rules->predhashsize - 1;
+	for(c = spindle_strhash(predicate) & mask; rules->predhash[c]; c = (c + 1) & mask)
+	{
+		entry = &(rules->predindex[rules->predhash[c] - 1]);
+		if(strcmp(entry->predicate, predicate))
+		{
+			continue;
+		}
+		for(n = rules->predhash[c] - 1; n < rules->predindexcount && !strcmp(rules->predindex[n].predicate, predicate); n++)
+		{
+			(*count)++;
+		}
+		return entry;
+	}
+	return NULL;
+}
+
 int
 spindle_rulebase_pred_cleanup(SPINDLERULES *rules)
 {
@@ -264,6 +345,12 @@ spindle_rulebase_pred_cleanup(SPINDLERULES *rules)
 	}
 	free(rules->predicates);
 	rules->predicates = NULL;
+	free(rules->predindex);
+	rules->predindex = NULL;
+	rules->predindexcount = 0;
+	free(rules->predhash);
+	rules->predhash = NULL;
+	rules->predhashsize = 0;
 	return 0;
 }
 
@@ -278,6 +365,29 @@ spindle_rulebase_pred_compare_(const void *ptra, const void *ptrb)
 	return a->score - b->score;
 }
 
+static int
+spindle_rulebase_pred_index_compare_(const void *ptra, const void *ptrb)
+{
+	const struct spindle_predicateindex_struct *a, *b;
+	int r;
+
+	a = (const struct spindle_predicateindex_struct *) ptra;
+	b = (const struct spindle_predicateindex_struct *) ptrb;
+	if((r = strcmp(a->predicate, b->predicate)))
+	{
+		return r;
+	}
+	if(a->map != b->map)
+	{
+		return (a->map < b->map ? -1 : 1);
+	}
+	if(a->match != b->match)
+	{
+		return (a->match < b->match ? -1 : 1);
+	}
+	return 0;
+}
+
 int
 spindle_rulebase_pred_dump(SPINDLERULES *rules)
 {
@@ -150,7 +150,10 @@ int
 spindle_rulebase_finalise(SPINDLERULES *rules)
 {
 	spindle_rulebase_class_finalise(rules);
-	spindle_rulebase_pred_finalise(rules);
+	if(spindle_rulebase_pred_finalise(rules))
+	{
+		return -1;
+	}
 	spindle_rulebase_cachepred_finalise(rules);	
 	return 0;
 }
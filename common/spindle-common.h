@@ -58,6 +58,30 @@
 # define NS_FRBR                        "http://purl.org/vocab/frbr/core#"
 # define NS_VOID                        "http://rdfs.org/ns/void#"
 
+/* Regeneration priorities: lower values are dequeued first */
+# define SPINDLE_PRIO_NONE              0
+# define SPINDLE_PRIO_URGENT            10
+# define SPINDLE_PRIO_NORMAL            50
+# define SPINDLE_PRIO_TRIGGER           70
+# define SPINDLE_PRIO_BULK              90
+
+/* Stages of generation, for which timings are recorded */
+# define SPINDLE_STAGE_STATE            0
+# define SPINDLE_STAGE_SOURCE           1
+# define SPINDLE_STAGE_TRIGGERS         2
+# define SPINDLE_STAGE_CLASSES          3
+# define SPINDLE_STAGE_PROPS            4
+# define SPINDLE_STAGE_DESCRIBE         5
+# define SPINDLE_STAGE_DOC              6
+# define SPINDLE_STAGE_LICENSE          7
+# define SPINDLE_STAGE_RELATED          8
+# define SPINDLE_STAGE_INDEX            9
+# define SPINDLE_STAGE_STORE            10
+# define SPINDLE_STAGE_UPDATE           11
+# define SPINDLE_STAGE_APPLY            12
+# define SPINDLE_STAGE_TOTAL            13
+# define SPINDLE_STAGE_COUNT            14
+
 /* MIME types */
 # define MIME_TURTLE                    "text/turtle"
 # define MIME_NQUADS                    "application/n-quads"
@@ -89,8 +113,28 @@ struct spindle_context_struct
 	int multigraph;
 	/* The rulebase */
 	SPINDLERULES *rules;
-	/* Cached information about graphs */
+	/* Cached contents of source graphs */
 	struct spindle_graphcache_struct *graphcache;
+	/* Cached self-descriptions of source graphs */
+	struct spindle_graphcache_struct *descriptions;
+	/* Graph descriptions shared with other processes, if enabled */
+	struct spindle_diskcache_struct *diskcache;
+	/* The oldest transaction which was still in progress when the
+	 * graph_version table was last checked, and the changes seen then
+	 * (sorted by sequence number)
+	 */
+	long graphxmin;
+	int graphpolled;
+	long *graphseen;
+	size_t ngraphseen;
+	/* The minimum interval between regenerations of an entity, in seconds */
+	int debounce;
+	/* Cached external URI to proxy mappings, if there's no RDBMS */
+	struct spindle_proxycache_struct *proxycache;
+	/* Timings and counters, if enabled */
+	struct spindle_stats_struct *stats;
+	/* Per-query-template SQL statistics, if enabled */
+	struct spindle_querystats_struct *querystats;
 };
 
 /* The rule-base object */
@@ -104,6 +148,14 @@ struct spindle_rulebase_struct
 	struct spindle_predicatemap_struct *predicates;
 	size_t predcount;
 	size_t predsize;
+	/* Predicate-matching data indexed by source predicate URI, sorted
+	 * by (predicate, map, match); predhash is an open-addressed index of
+	 * the first entry for each predicate (plus one, or zero if empty)
+	 */
+	struct spindle_predicateindex_struct *predindex;
+	size_t predindexcount;
+	size_t *predhash;
+	size_t predhashsize;
 	/* Predicates which are cached */
 	char **cachepreds;
 	size_t cpcount;
@@ -115,12 +167,6 @@ struct spindle_rulebase_struct
 	size_t corefsize;
 };
 
-struct spindle_graphcache_struct
-{
-	char *uri;
-	librdf_model *model;
-};
-
 /* A set of literal strings */
 struct spindle_literalset_struct
 {
@@ -140,6 +186,13 @@ struct spindle_strset_struct
 	unsigned *flags;
 	size_t count;
 	size_t size;
+	/* Open-addressed index of strings; each slot holds a strings index
+	 * plus one, or zero if the slot is empty
+	 */
+	size_t *hash;
+	size_t hashsize;
+	/* Arena blocks from which the strings are allocated */
+	struct spindle_strset_block_struct *blocks;
 };
 
 /* Mapping data for a class. 'uri' is the full class URI which will be
@@ -206,6 +259,16 @@ struct spindle_predicatematch_struct
 	int inverse;
 };
 
+/* An entry in the predicate index: 'map' and 'match' are indices into
+ * the predicates list and that predicate's matches list respectively
+ */
+struct spindle_predicateindex_struct
+{
+	const char *predicate;
+	size_t map;
+	size_t match;
+};
+
 struct spindle_coref_struct
 {
 	char *left;
@@ -217,6 +280,11 @@ struct spindle_corefset_struct
 	struct spindle_coref_struct *refs;
 	size_t refcount;
 	size_t size;
+	/* Open-addressed index of refs (by left URI); each slot holds a
+	 * refs index plus one, or zero if the slot is empty
+	 */
+	size_t *hash;
+	size_t hashsize;
 };
 
 struct coref_match_struct
@@ -250,33 +318,62 @@ int spindle_rulebase_finalise(SPINDLERULES *rules);
 int spindle_rulebase_destroy(SPINDLERULES *rules);
 /* Dump the contents of the loaded rulebase */
 int spindle_rulebase_dump(SPINDLERULES *rules);
+/* Find the predicate index entries matching a source predicate URI */
+const struct spindle_predicateindex_struct *spindle_rulebase_pred_lookup(SPINDLERULES *rules, const char *predicate, size_t *count);
 
 /* Create an empty string-set */
 struct spindle_strset_struct *spindle_strset_create(void);
 /* Add a string to a string-set */
 int spindle_strset_add(struct spindle_strset_struct *set, const char *str);
 int spindle_strset_add_flags(struct spindle_strset_struct *set, const char *str, unsigned flags);
+/* Determine whether a string-set contains a string */
+int spindle_strset_contains(struct spindle_strset_struct *set, const char *str);
+int spindle_strset_index(struct spindle_strset_struct *set, const char *str, size_t *index);
 /* Free the resources used by a string set */
 int spindle_strset_destroy(struct spindle_strset_struct *set);
+/* Compute a hash of a string for use in hash-indexed sets */
+unsigned long spindle_strhash(const char *str);
 
 /* Utility functions used by SQL interaction code */
 int spindle_db_init(SPINDLE *spindle);
+int spindle_db_reconnect(SPINDLE *spindle);
 int spindle_db_cleanup(SPINDLE *spindle);
+SQL_STATEMENT *spindle_db_queryf(SQL *sql, const char *format, ...);
+int spindle_db_executef(SQL *sql, const char *format, ...);
+int spindle_db_perform(SPINDLE *spindle, SQL *sql, SQL_PERFORM_TXN fn, void *data, SQL_TXN_MODE mode);
 int spindle_db_local(SPINDLE *spindle, const char *localname);
 char *spindle_db_id(const char *localname);
 int spindle_db_id_copy(char *dest, const char *localname);
 char *spindle_db_literalset(struct spindle_literalset_struct *set);
 char *spindle_db_strset(struct spindle_strset_struct *set);
+char *spindle_db_strarray(const char **strings, size_t count);
 size_t spindle_db_esclen(const char *src);
 char *spindle_db_escstr(char *dest, const char *src);
 char *spindle_db_escstr_lower(char *dest, const char *src);
+/* Mark an existing state entry as dirty, coalescing with any pending or
+ * in-flight regeneration */
+int spindle_db_state_dirty(SPINDLE *spindle, SQL *sql, const char *id, int flags, int priority, const char *modified);
+/* Mark all of the entities triggered by an entity as dirty */
+int spindle_db_state_trigger(SPINDLE *spindle, SQL *sql, const char *triggerid, int flags, int priority);
+/* Record that a source graph has changed */
+int spindle_db_graph_changed(SPINDLE *spindle, const char *uri);
+/* Discard cached copies of source graphs which have changed */
+int spindle_db_graph_sync(SPINDLE *spindle);
+/* Obtain the most recent change recorded for each of a list of graphs */
+int spindle_db_graph_versions(SPINDLE *spindle, const char **uris, size_t count, long *versions);
 
 /* Assert that two URIs are equivalent */
 int spindle_proxy_create(SPINDLE *spindle, const char *uri1, const char *uri2, struct spindle_strset_struct *changeset);
+/* Assert all of the equivalences in a co-reference set */
+int spindle_proxy_create_set(SPINDLE *spindle, struct spindle_corefset_struct *corefs, struct spindle_strset_struct *changeset);
 /* Generate a new local URI for an external URI */
 char *spindle_proxy_generate(SPINDLE *spindle, const char *uri);
 /* Look up the local URI for an external URI in the store */
 char *spindle_proxy_locate(SPINDLE *spindle, const char *uri);
+/* Look up the local URIs for a list of external URIs with as few queries as
+ * possible; localnames[n] is set to a newly-allocated string, or NULL if
+ * uris[n] has no proxy */
+int spindle_proxy_locate_many(SPINDLE *spindle, const char **uris, size_t count, char **localnames);
 /* Move a set of references from one proxy to another */
 int spindle_proxy_migrate(SPINDLE *spindle, const char *from, const char *to, char **refs);
 /* Store a relationship between a proxy and an external entity */
@@ -288,9 +385,24 @@ void spindle_proxy_refs_destroy(char **refs);
 
 /* Retrieve the contents of a graph */
 librdf_model *spindle_graphcache_fetch_node(SPINDLE *spindle, librdf_node *graph);
+/* Retrieve the descriptions of several graphs in a single request */
+int spindle_graphcache_prefetch_descriptions(SPINDLE *spindle, librdf_node **graphs, size_t count);
+/* Retrieve the contents of several graphs in a single request */
+int spindle_graphcache_prefetch_graphs(SPINDLE *spindle, librdf_node **graphs, size_t count);
 /* Discard a graph */
 int spindle_graphcache_discard(SPINDLE *spindle, const char *uri);
 /* Copy a description of a graph */
 int spindle_graphcache_description_node(SPINDLE *spindle, librdf_model *target, librdf_node *graph);
 
+/* Statistics collection */
+unsigned long long spindle_stats_clock(void);
+const char *spindle_stats_stage_name(int stage);
+void spindle_stats_stage(SPINDLE *spindle, int stage, unsigned long long usec);
+void spindle_stats_entity(SPINDLE *spindle, int failed);
+void spindle_stats_sql(SPINDLE *spindle, size_t bytes);
+void spindle_stats_sparql(SPINDLE *spindle, size_t bytes);
+int spindle_stats_flush(SPINDLE *spindle, int force);
+/* Record the number of rows returned or affected by the last SQL statement */
+void spindle_querystats_rows(SPINDLE *spindle, long rows);
+
 #endif /*!SPINDLE_COMMON_H_*/
@@ -0,0 +1,288 @@
+/* Spindle: Co-reference aggregation engine
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_spindle.h"
+
+/* Process-wide statistics: latency histograms for each stage of generation
+ * and counters of SQL and SPARQL round-trips. If spindle:stats-file is set,
+ * they are periodically written to that file, in the Prometheus text
+ * exposition format, so that they can be collected without enabling debug
+ * logging. Otherwise, collection is disabled altogether.
+ */
+
+static int spindle_stats_write_(SPINDLE *spindle);
+static void spindle_stats_histogram_(FILE *f, const char *name, const char *label, struct spindle_histogram_struct *hist);
+
+static const char *stage_names[SPINDLE_STAGE_COUNT] = {
+	"state", "source", "triggers", "classes", "props", "describe", "doc",
+	"licence", "related", "index", "store", "update", "apply", "total"
+};
+
+/* Histogram bucket upper bounds, in microseconds */
+static const unsigned long long bucket_bounds[SPINDLE_STATS_BUCKETS] = {
+	1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+	1000000, 2500000, 5000000, 10000000
+};
+
+/* Create the statistics collector, if enabled */
+int
+spindle_stats_init(SPINDLE *spindle)
+{
+	struct spindle_stats_struct *stats;
+	char *path;
+
+	path = twine_config_geta("spindle:stats-file", NULL);
+	if(!path || !path[0])
+	{
+		free(path);
+		return 0;
+	}
+	stats = (struct spindle_stats_struct *) calloc(1, sizeof(struct spindle_stats_struct));
+	if(!stats)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate statistics\n");
+		free(path);
+		return -1;
+	}
+	stats->path = path;
+	stats->interval = twine_config_get_int("spindle:stats-interval", 60);
+	stats->started = time(NULL);
+	stats->flushed = stats->started;
+	spindle->stats = stats;
+	twine_logf(LOG_INFO, PLUGIN_NAME ": statistics will be written to %s\n", path);
+	return 0;
+}
+
+/* Write the final statistics and destroy the collector */
+int
+spindle_stats_cleanup(SPINDLE *spindle)
+{
+	if(!spindle->stats)
+	{
+		return 0;
+	}
+	spindle_stats_flush(spindle, 1);
+	free(spindle->stats->path);
+	free(spindle->stats);
+	spindle->stats = NULL;
+	return 0;
+}
+
+/* Return a monotonic timestamp, in microseconds, for measuring intervals */
+unsigned long long
+spindle_stats_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((unsigned long long) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+/* Return the name of a generation stage */
+const char *
+spindle_stats_stage_name(int stage)
+{
+	if(stage < 0 || stage >= SPINDLE_STAGE_COUNT)
+	{
+		return "unknown";
+	}
+	return stage_names[stage];
+}
+
+/* Record the time taken by a stage, in microseconds */
+void
+spindle_stats_stage(SPINDLE *spindle, int stage, unsigned long long usec)
+{
+	struct spindle_histogram_struct *hist;
+	size_t c;
+
+	if(!spindle->stats || stage < 0 || stage >= SPINDLE_STAGE_COUNT)
+	{
+		return;
+	}
+	hist = &(spindle->stats->stages[stage]);
+	hist->count++;
+	hist->sum += usec;
+	for(c = 0; c < SPINDLE_STATS_BUCKETS && usec > bucket_bounds[c]; c++);
+	if(c < SPINDLE_STATS_BUCKETS)
+	{
+		hist->buckets[c]++;
+	}
+}
+
+/* Record the outcome of generating an entity */
+void
+spindle_stats_entity(SPINDLE *spindle, int failed)
+{
+	if(!spindle->stats)
+	{
+		return;
+	}
+	spindle->stats->entities++;
+	if(failed)
+	{
+		spindle->stats->failures++;
+	}
+}
+
+/* Record an SQL round-trip */
+void
+spindle_stats_sql(SPINDLE *spindle, size_t bytes)
+{
+	if(!spindle->stats)
+	{
+		return;
+	}
+	spindle->stats->sqlqueries++;
+	spindle->stats->sqlbytes += bytes;
+}
+
+/* Record a SPARQL round-trip; bytes is the size of the request, or zero if
+ * it isn't known
+ */
+void
+spindle_stats_sparql(SPINDLE *spindle, size_t bytes)
+{
+	if(!spindle->stats)
+	{
+		return;
+	}
+	spindle->stats->sparqlqueries++;
+	spindle->stats->sparqlbytes += bytes;
+}
+
+/* Write the statistics to the stats file if the flush interval has elapsed,
+ * or unconditionally if force is set
+ */
+int
+spindle_stats_flush(SPINDLE *spindle, int force)
+{
+	time_t now;
+
+	if(!spindle->stats)
+	{
+		return 0;
+	}
+	now = time(NULL);
+	if(!force && now - spindle->stats->flushed < spindle->stats->interval)
+	{
+		return 0;
+	}
+	spindle->stats->flushed = now;
+	return spindle_stats_write_(spindle);
+}
+
+/* Write the statistics to a temporary file, then move it into place so that
+ * readers never see a partially-written file; any "%p" in the path is
+ * replaced with the process ID, so that worker processes don't overwrite
+ * each other's statistics
+ */
+static int
+spindle_stats_write_(SPINDLE *spindle)
+{
+	struct spindle_stats_struct *stats;
+	char path[PATH_MAX], tmp[PATH_MAX + 32], label[64];
+	const char *s;
+	size_t c;
+	FILE *f;
+
+	stats = spindle->stats;
+	for(s = stats->path, c = 0; *s && c < sizeof(path) - 16; s++)
+	{
+		if(s[0] == '%' && s[1] == 'p')
+		{
+			c += sprintf(&(path[c]), "%ld", (long) getpid());
+			s++;
+			continue;
+		}
+		path[c] = *s;
+		c++;
+	}
+	path[c] = 0;
+	snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long) getpid());
+	f = fopen(tmp, "w");
+	if(!f)
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": failed to open %s for writing: %s\n", tmp, strerror(errno));
+		return -1;
+	}
+	fprintf(f, "# HELP spindle_start_time_seconds Time at which statistics collection began\n"
+			"# TYPE spindle_start_time_seconds gauge\n"
+			"spindle_start_time_seconds %ld\n", (long) stats->started);
+	fprintf(f, "# HELP spindle_entities_total Entities generated\n"
+			"# TYPE spindle_entities_total counter\n"
+			"spindle_entities_total %lu\n", stats->entities);
+	fprintf(f, "# HELP spindle_entity_failures_total Entities which failed to generate\n"
+			"# TYPE spindle_entity_failures_total counter\n"
+			"spindle_entity_failures_total %lu\n", stats->failures);
+	fprintf(f, "# HELP spindle_sql_queries_total SQL statements executed\n"
+			"# TYPE spindle_sql_queries_total counter\n"
+			"spindle_sql_queries_total %lu\n", stats->sqlqueries);
+	fprintf(f, "# HELP spindle_sql_bytes_total Size of SQL statements executed\n"
+			"# TYPE spindle_sql_bytes_total counter\n"
+			"spindle_sql_bytes_total %llu\n", stats->sqlbytes);
+	fprintf(f, "# HELP spindle_sparql_requests_total SPARQL requests made\n"
+			"# TYPE spindle_sparql_requests_total counter\n"
+			"spindle_sparql_requests_total %lu\n", stats->sparqlqueries);
+	fprintf(f, "# HELP spindle_sparql_bytes_total Size of SPARQL queries sent\n"
+			"# TYPE spindle_sparql_bytes_total counter\n"
+			"spindle_sparql_bytes_total %llu\n", stats->sparqlbytes);
+	fprintf(f, "# HELP spindle_stage_seconds Time spent in each stage of generation\n"
+			"# TYPE spindle_stage_seconds histogram\n");
+	for(c = 0; c < SPINDLE_STAGE_COUNT; c++)
+	{
+		snprintf(label, sizeof(label), "stage=\"%s\"", stage_names[c]);
+		spindle_stats_histogram_(f, "spindle_stage_seconds", label, &(stats->stages[c]));
+	}
+	if(fclose(f))
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": failed to write %s: %s\n", tmp, strerror(errno));
+		unlink(tmp);
+		return -1;
+	}
+	if(rename(tmp, path))
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": failed to rename %s to %s: %s\n", tmp, path, strerror(errno));
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+/* Write a single histogram, with cumulative buckets */
+static void
+spindle_stats_histogram_(FILE *f, const char *name, const char *label, struct spindle_histogram_struct *hist)
+{
+	unsigned long total;
+	size_t c;
+
+	total = 0;
+	for(c = 0; c < SPINDLE_STATS_BUCKETS; c++)
+	{
+		total += hist->buckets[c];
+		fprintf(f, "%s_bucket{%s,le=\"%g\"} %lu\n", name, label, (double) bucket_bounds[c] / 1000000.0, total);
+	}
+	fprintf(f, "%s_bucket{%s,le=\"+Inf\"} %lu\n", name, label, hist->count);
+	fprintf(f, "%s_sum{%s} %.6f\n", name, label, (double) hist->sum / 1000000.0);
+	fprintf(f, "%s_count{%s} %lu\n", name, label, hist->count);
+}
@@ -23,6 +23,9 @@
 
 #include "p_spindle.h"
 
+static int spindle_strset_rehash_(struct spindle_strset_struct *set, size_t hashsize);
+static char *spindle_strset_strdup_(struct spindle_strset_struct *set, const char *str);
+
 /* Create an empty string-set */
 struct spindle_strset_struct *
 spindle_strset_create(void)
@@ -50,35 +53,60 @@ spindle_strset_add_flags(struct spindle_strset_struct *set, const char *str, uns
 {
 	char **p;
 	unsigned *q;
-	size_t c;
+	size_t c, size, mask;
 
-	for(c = 0; c < set->count; c++)
+	if(set->count < STRSET_HASHMIN)
+	{
+		/* Small sets are cheaper to scan than to index */
+		for(c = 0; c < set->count; c++)
+		{
+			if(!strcmp(set->strings[c], str))
+			{
+				set->flags[c] |= flags;
+				return 0;
+			}
+		}
+	}
+	else
 	{
-		if(!strcmp(set->strings[c], str))
+		/* Keep the index at most half full */
+		if((set->count + 1) * 2 > set->hashsize)
+		{
+			if(spindle_strset_rehash_(set, set->hashsize ? set->hashsize * 2 : STRSET_HASHMIN * 4))
+			{
+				return -1;
+			}
+		}
+		mask = set->hashsize - 1;
+		for(c = spindle_strhash(str) & mask; set->hash[c]; c = (c + 1) & mask)
 		{
-			set->flags[c] |= flags;
-			return 0;
+			if(!strcmp(set->strings[set->hash[c] - 1], str))
+			{
+				set->flags[set->hash[c] - 1] |= flags;
+				return 0;
+			}
 		}
-	}	
+	}
 	if(set->count + 1 >= set->size)
 	{
-		p = (char **) realloc(set->strings, sizeof(char *) * (set->size + SET_BLOCKSIZE));
+		size = set->size ? set->size * 2 : SET_BLOCKSIZE;
+		p = (char **) realloc(set->strings, sizeof(char *) * size);
 		if(!p)
 		{
 			twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to expand string-set\n");
 			return -1;
 		}
-		q = (unsigned *) realloc(set->flags, sizeof(unsigned) * (set->size + SET_BLOCKSIZE));
-		if(!p)
+		set->strings = p;
+		q = (unsigned *) realloc(set->flags, sizeof(unsigned) * size);
+		if(!q)
 		{
 			twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to expand flag-set\n");
 			return -1;
 		}
-		set->size += SET_BLOCKSIZE;
-		set->strings = p;
 		set->flags = q;
+		set->size = size;
 	}
-	set->strings[set->count] = strdup(str);
+	set->strings[set->count] = spindle_strset_strdup_(set, str);
 	set->flags[set->count] = flags;
 	if(!set->strings[set->count])
 	{
@@ -86,6 +114,56 @@ spindle_strset_add_flags(struct spindle_strset_struct *set, const char *str, uns
 		return -1;
 	}
 	set->count++;
+	if(set->hash)
+	{
+		/* c is the empty slot which terminated the probe above */
+		set->hash[c] = set->count;
+	}
+	return 0;
+}
+
+/* Determine whether a string-set contains a string */
+int
+spindle_strset_contains(struct spindle_strset_struct *set, const char *str)
+{
+	return spindle_strset_index(set, str, NULL);
+}
+
+/* Determine whether a string-set contains a string, and if so, optionally
+ * obtain its index within set->strings
+ */
+int
+spindle_strset_index(struct spindle_strset_struct *set, const char *str, size_t *index)
+{
+	size_t c, mask;
+
+	if(!set->hash)
+	{
+		for(c = 0; c < set->count; c++)
+		{
+			if(!strcmp(set->strings[c], str))
+			{
+				if(index)
+				{
+					*index = c;
+				}
+				return 1;
+			}
+		}
+		return 0;
+	}
+	mask = set->hashsize - 1;
+	for(c = spindle_strhash(str) & mask; set->hash[c]; c = (c + 1) & mask)
+	{
+		if(!strcmp(set->strings[set->hash[c] - 1], str))
+		{
+			if(index)
+			{
+				*index = set->hash[c] - 1;
+			}
+			return 1;
+		}
+	}
 	return 0;
 }
 
@@ -93,14 +171,90 @@ spindle_strset_add_flags(struct spindle_strset_struct *set, const char *str, uns
 int
 spindle_strset_destroy(struct spindle_strset_struct *set)
 {
-	size_t c;
+	struct spindle_strset_block_struct *block, *next;
 
-	for(c = 0; c < set->count; c++)
+	for(block = set->blocks; block; block = next)
 	{
-		free(set->strings[c]);
+		next = block->next;
+		free(block);
 	}
+	free(set->hash);
 	free(set->flags);
 	free(set->strings);
 	free(set);
 	return 0;
 }
+
+/* Rebuild the hash index of a string-set; hashsize must be a power of two */
+static int
+spindle_strset_rehash_(struct spindle_strset_struct *set, size_t hashsize)
+{
+	size_t *hash;
+	size_t c, n, mask;
+
+	hash = (size_t *) calloc(hashsize, sizeof(size_t));
+	if(!hash)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate string-set index\n");
+		return -1;
+	}
+	mask = hashsize - 1;
+	for(n = 0; n < set->count; n++)
+	{
+		for(c = spindle_strhash(set->strings[n]) & mask; hash[c]; c = (c + 1) & mask);
+		hash[c] = n + 1;
+	}
+	free(set->hash);
+	set->hash = hash;
+	set->hashsize = hashsize;
+	return 0;
+}
+
+/* Copy a string into the set's arena, allocating a new block if needed */
+static char *
+spindle_strset_strdup_(struct spindle_strset_struct *set, const char *str)
+{
+	struct spindle_strset_block_struct *block;
+	size_t len, size;
+	char *p;
+
+	len = strlen(str) + 1;
+	block = set->blocks;
+	if(!block || block->size - block->used < len)
+	{
+		/* Each block is twice the size of the last */
+		size = block ? block->size * 2 : STRSET_BLOCKSIZE;
+		if(len > size)
+		{
+			size = len;
+		}
+		block = (struct spindle_strset_block_struct *) malloc(sizeof(struct spindle_strset_block_struct) + size);
+		if(!block)
+		{
+			return NULL;
+		}
+		block->size = size;
+		block->used = 0;
+		block->next = set->blocks;
+		set->blocks = block;
+	}
+	p = &(block->data[block->used]);
+	memcpy(p, str, len);
+	block->used += len;
+	return p;
+}
+
+/* Compute a hash of a string for use in hash-indexed sets (FNV-1a) */
+unsigned long
+spindle_strhash(const char *str)
+{
+	unsigned long h;
+
+	h = 2166136261UL;
+	for(; *str; str++)
+	{
+		h ^= (unsigned char) *str;
+		h *= 16777619UL;
+	}
+	return h;
+}
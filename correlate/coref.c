@@ -24,6 +24,7 @@
 #include "p_spindle-correlate.h"
 
 static int spindle_coref_add_(struct spindle_corefset_struct *set, const char *l, const char *r);
+static int spindle_coref_rehash_(struct spindle_corefset_struct *set, size_t hashsize);
 
 struct spindle_corefset_struct *
 spindle_coref_create(void)
@@ -162,6 +163,7 @@ spindle_coref_destroy(struct spindle_corefset_struct *set)
 		free(set->refs[c].right);
 	}
 	free(set->refs);
+	free(set->hash);
 	free(set);
 	return 0;
 }
@@ -208,12 +210,25 @@ static int
 spindle_coref_add_(struct spindle_corefset_struct *set, const char *l, const char *r)
 {
 	struct spindle_coref_struct *p;
-	size_t c;
+	size_t c, size, mask;
 
-	for(c = 0; c < set->refcount; c++)
+	/* Keep the index at most half full */
+	if((set->refcount + 1) * 2 > set->hashsize)
+	{
+		if(spindle_coref_rehash_(set, set->hashsize ? set->hashsize * 2 : SET_BLOCKSIZE * 4))
+		{
+			return -1;
+		}
+	}
+	/* All of the references with the same left-hand URI share a probe
+	 * sequence, so stop at the first empty slot
+	 */
+	mask = set->hashsize - 1;
+	for(c = spindle_strhash(l) & mask; set->hash[c]; c = (c + 1) & mask)
 	{
-		if(!strcmp(l, set->refs[c].left) &&
-		   (!r || !strcmp(r, set->refs[c].right)))
+		p = &(set->refs[set->hash[c] - 1]);
+		if(!strcmp(l, p->left) &&
+		   (!r || (p->right && !strcmp(r, p->right))))
 		{
 /*			twine_logf(LOG_DEBUG, "(reference already exists)\n"); */
 			return 0;
@@ -221,14 +236,15 @@ spindle_coref_add_(struct spindle_corefset_struct *set, const char *l, const cha
 	}
 	if(set->refcount >= set->size)
 	{
-		p = (struct spindle_coref_struct *) realloc(set->refs, sizeof(struct spindle_coref_struct) * (set->size + SET_BLOCKSIZE));
+		size = set->size ? set->size * 2 : SET_BLOCKSIZE;
+		p = (struct spindle_coref_struct *) realloc(set->refs, sizeof(struct spindle_coref_struct) * size);
 		if(!p)
 		{
 			twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to expand size of coreference set\n");
 			return -1;
 		}
 		set->refs = p;
-		set->size += SET_BLOCKSIZE;
+		set->size = size;
 	}
 	p = &(set->refs[set->refcount]);
 	memset(p, 0, sizeof(struct spindle_coref_struct));
@@ -244,7 +260,36 @@ spindle_coref_add_(struct spindle_corefset_struct *set, const char *l, const cha
 		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to duplicate URIs when adding coreference to set\n");
 		return -1;
 	}
+	/* c is the empty slot which terminated the probe above */
 	set->refcount++;
+	set->hash[c] = set->refcount;
 /*	twine_logf(LOG_DEBUG, "refcount=%d, (added %s = %s)\n", (int) set->refcount, p->left, p->right); */
 	return 0;
 }
+
+/* Rebuild the hash index of a co-reference set; hashsize must be a power
+ * of two
+ */
+static int
+spindle_coref_rehash_(struct spindle_corefset_struct *set, size_t hashsize)
+{
+	size_t *hash;
+	size_t c, n, mask;
+
+	hash = (size_t *) calloc(hashsize, sizeof(size_t));
+	if(!hash)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate coreference set index\n");
+		return -1;
+	}
+	mask = hashsize - 1;
+	for(n = 0; n < set->refcount; n++)
+	{
+		for(c = spindle_strhash(set->refs[n].left) & mask; hash[c]; c = (c + 1) & mask);
+		hash[c] = n + 1;
+	}
+	free(set->hash);
+	set->hash = hash;
+	set->hashsize = hashsize;
+	return 0;
+}
@@ -77,17 +77,15 @@ twine_plugin_done(void)
 	return 0;
 }
 
-/* Discard cached information about a graph */
+/* Discard cached information about a graph which has been updated: the
+ * correlator keeps no graphs in memory itself, but the change is recorded
+ * so that generation processes (which do) can discard their copies, and any
+ * description cached on disk on this host is removed immediately
+ */
 int
 spindle_graph_discard(SPINDLE *spindle, const char *uri)
 {
-	/* This is a no-op in the stand-alone post-processor; it can be
-	 * removed when we no longer have a monolithic module.
-	 */
-
-	(void) spindle;
-	(void) uri;
-
-	return 0;
+	spindle_graphcache_discard(spindle, uri);
+	return spindle_db_graph_changed(spindle, uri);
 }
 
@@ -51,7 +51,13 @@ spindle_correlate(twine_graph *graph, void *data)
 
 	spindle = (SPINDLE *) data;
 	twine_logf(LOG_INFO, PLUGIN_NAME ": evaluating updated graph <%s>\n", graph->uri);
-	spindle_graph_discard(spindle, graph->uri);
+	/* Record the change before any entity drawing on the graph can be
+	 * marked dirty, or it may be generated from a stale cached copy
+	 */
+	if(spindle_graph_discard(spindle, graph->uri))
+	{
+		return -1;
+	}
 	changes = spindle_strset_create();
 	if(!changes)
 	{
@@ -99,6 +105,7 @@ spindle_correlate(twine_graph *graph, void *data)
 	spindle_coref_destroy(oldset);
 	spindle_coref_destroy(newset);
 	spindle_strset_destroy(changes);
+	spindle_stats_flush(spindle, 0);
 	if(r)
 	{
 		twine_logf(LOG_ERR, PLUGIN_NAME ": failed to create proxy entities for graph <%s>\n", graph->uri);
@@ -113,14 +120,9 @@ spindle_correlate(twine_graph *graph, void *data)
 static int
 spindle_correlate_internal_(struct spindle_correlate_data_struct *cbdata)
 {
-	size_t c;
-	
-	for(c = 0; c < cbdata->newset->refcount; c++)
+	if(spindle_proxy_create_set(cbdata->spindle, cbdata->newset, cbdata->changes))
 	{
-		if(spindle_proxy_create(cbdata->spindle, cbdata->newset->refs[c].left, cbdata->newset->refs[c].right, cbdata->changes))
-		{
-			return SQL_TXN_FAIL;
-		}
+		return SQL_TXN_FAIL;
 	}
 	return SQL_TXN_COMMIT;
 }
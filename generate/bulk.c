@@ -0,0 +1,528 @@
+/* Spindle: Co-reference aggregation engine
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_spindle-generate.h"
+
+/* Bulk re-generation of all known proxies
+ *
+ * The proxy table is divided into 'workers' contiguous ranges of UUIDs,
+ * each of which is processed by a separate worker process (or in-process
+ * if there's only one worker). Each worker pages through its range in UUID
+ * order, recording its position in the "generate_checkpoint" table after
+ * each page, so that an interrupted run will resume where it left off.
+ *
+ * Workers report their progress to the parent over a pipe, one line per
+ * entity, which the parent aggregates into periodic progress reports and
+ * a final summary.
+ */
+
+struct spindle_bulk_struct
+{
+	SPINDLEGENERATE *generate;
+	int workers;
+	int worker;
+	int batch;
+	int interval;
+	/* Write end of the reporting pipe (workers), or -1 if in-process */
+	int fd;
+	/* Aggregated progress */
+	unsigned long processed;
+	unsigned long failed;
+	struct spindle_strset_struct *failures;
+	unsigned long long start;
+	unsigned long long lastreport;
+	unsigned long lastprocessed;
+};
+
+static int spindle_bulk_worker_(struct spindle_bulk_struct *bulk);
+static int spindle_bulk_worker_connect_(struct spindle_bulk_struct *bulk);
+static int spindle_bulk_page_(struct spindle_bulk_struct *bulk, const char *lower, const char *upper, char *after, unsigned long *processed, unsigned long *failed);
+static int spindle_bulk_checkpoint_(struct spindle_bulk_struct *bulk, const char *after, unsigned long processed, unsigned long failed, int complete);
+static int spindle_bulk_report_(struct spindle_bulk_struct *bulk, const char *id, int failed);
+static int spindle_bulk_tally_(struct spindle_bulk_struct *bulk, const char *line);
+static int spindle_bulk_progress_(struct spindle_bulk_struct *bulk, int final);
+static int spindle_bulk_collect_(struct spindle_bulk_struct *bulk, int fd);
+static int spindle_bulk_finish_(struct spindle_bulk_struct *bulk);
+static void spindle_bulk_range_(int workers, int worker, char *lower, char *upper);
+static unsigned long long spindle_bulk_now_(void);
+
+/* Re-generate all known proxies */
+int
+spindle_generate_all(SPINDLEGENERATE *generate)
+{
+	struct spindle_bulk_struct bulk;
+	pid_t *pids;
+	int fds[2], c, status, r;
+
+	memset(&bulk, 0, sizeof(bulk));
+	bulk.generate = generate;
+	bulk.fd = -1;
+	bulk.workers = twine_config_get_int(PLUGIN_NAME ":bulk-workers", twine_config_get_int("spindle:bulk-workers", 1));
+	bulk.batch = twine_config_get_int(PLUGIN_NAME ":bulk-batch", twine_config_get_int("spindle:bulk-batch", 100));
+	bulk.interval = twine_config_get_int(PLUGIN_NAME ":bulk-progress", twine_config_get_int("spindle:bulk-progress", 30));
+	if(bulk.workers < 1)
+	{
+		bulk.workers = 1;
+	}
+	if(bulk.batch < 1)
+	{
+		bulk.batch = 100;
+	}
+	bulk.failures = spindle_strset_create();
+	if(!bulk.failures)
+	{
+		return -1;
+	}
+	bulk.start = spindle_bulk_now_();
+	bulk.lastreport = bulk.start;
+	twine_logf(LOG_NOTICE, PLUGIN_NAME ": bulk: re-generating all proxies using %d worker(s), %d per batch\n", bulk.workers, bulk.batch);
+	if(bulk.workers == 1)
+	{
+		r = spindle_bulk_worker_(&bulk);
+		spindle_bulk_progress_(&bulk, 1);
+		if(!r)
+		{
+			r = spindle_bulk_finish_(&bulk);
+		}
+		spindle_strset_destroy(bulk.failures);
+		return (r || bulk.failed) ? -1 : 0;
+	}
+	pids = (pid_t *) calloc(bulk.workers, sizeof(pid_t));
+	if(!pids)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate worker list\n");
+		spindle_strset_destroy(bulk.failures);
+		return -1;
+	}
+	if(pipe(fds))
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": bulk: failed to create reporting pipe: %s\n", strerror(errno));
+		free(pids);
+		spindle_strset_destroy(bulk.failures);
+		return -1;
+	}
+	r = 0;
+	for(c = 0; c < bulk.workers; c++)
+	{
+		pids[c] = fork();
+		if(pids[c] == -1)
+		{
+			twine_logf(LOG_CRIT, PLUGIN_NAME ": bulk: failed to start worker %d: %s\n", c, strerror(errno));
+			r = -1;
+			break;
+		}
+		if(!pids[c])
+		{
+			/* Worker process: this must never return to Twine, nor run
+			 * its clean-up handlers, which would tear down the parent's
+			 * connections.
+			 */
+			close(fds[0]);
+			bulk.fd = fds[1];
+			bulk.worker = c;
+			r = spindle_bulk_worker_(&bulk);
+			/* Report this worker's query statistics and close its own
+			 * database connection
+			 */
+			spindle_db_cleanup(bulk.generate->spindle);
+			_exit(r ? 1 : 0);
+		}
+	}
+	close(fds[1]);
+	spindle_bulk_collect_(&bulk, fds[0]);
+	close(fds[0]);
+	for(c = 0; c < bulk.workers; c++)
+	{
+		if(pids[c] <= 0)
+		{
+			continue;
+		}
+		if(waitpid(pids[c], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status))
+		{
+			twine_logf(LOG_ERR, PLUGIN_NAME ": bulk: worker %d did not complete successfully\n", c);
+			r = -1;
+		}
+	}
+	free(pids);
+	spindle_bulk_progress_(&bulk, 1);
+	if(!r)
+	{
+		r = spindle_bulk_finish_(&bulk);
+	}
+	spindle_strset_destroy(bulk.failures);
+	return (r || bulk.failed) ? -1 : 0;
+}
+
+/* Process a single worker's range of proxies */
+static int
+spindle_bulk_worker_(struct spindle_bulk_struct *bulk)
+{
+	SQL_STATEMENT *rs;
+	char lower[40], upper[40], after[40];
+	unsigned long processed, failed;
+	const char *t;
+	int r;
+
+	if(bulk->fd != -1 && spindle_bulk_worker_connect_(bulk))
+	{
+		return -1;
+	}
+	spindle_bulk_range_(bulk->workers, bulk->worker, lower, upper);
+	after[0] = 0;
+	processed = 0;
+	failed = 0;
+	rs = spindle_db_queryf(bulk->generate->db, "SELECT \"lastid\", \"complete\", \"processed\", \"failed\" FROM \"generate_checkpoint\" WHERE \"workers\" = %d AND \"worker\" = %d", bulk->workers, bulk->worker);
+	if(!rs)
+	{
+		return -1;
+	}
+	if(sql_stmt_eof(rs))
+	{
+		sql_stmt_destroy(rs);
+		if(spindle_db_executef(bulk->generate->db, "INSERT INTO \"generate_checkpoint\" (\"workers\", \"worker\", \"lastid\", \"complete\", \"processed\", \"failed\", \"modified\") VALUES (%d, %d, NULL, 'f', 0, 0, now() AT TIME ZONE 'UTC')", bulk->workers, bulk->worker))
+		{
+			return -1;
+		}
+	}
+	else
+	{
+		if((t = sql_stmt_str(rs, 1)) && (*t == 't' || *t == '1'))
+		{
+			twine_logf(LOG_NOTICE, PLUGIN_NAME ": bulk: worker %d has already completed its range\n", bulk->worker);
+			sql_stmt_destroy(rs);
+			return 0;
+		}
+		if((t = sql_stmt_str(rs, 0)) && *t)
+		{
+			strncpy(after, t, sizeof(after) - 1);
+			after[sizeof(after) - 1] = 0;
+			processed = sql_stmt_ulong(rs, 2);
+			failed = sql_stmt_ulong(rs, 3);
+			twine_logf(LOG_NOTICE, PLUGIN_NAME ": bulk: worker %d resuming after {%s} (%lu processed, %lu failed)\n", bulk->worker, after, processed, failed);
+		}
+		sql_stmt_destroy(rs);
+	}
+	twine_logf(LOG_INFO, PLUGIN_NAME ": bulk: worker %d processing {%s} to {%s}\n", bulk->worker, lower, upper);
+	while((r = spindle_bulk_page_(bulk, lower, upper, after, &processed, &failed)) > 0)
+	{
+		if(spindle_bulk_checkpoint_(bulk, after, processed, failed, 0))
+		{
+			return -1;
+		}
+	}
+	if(r < 0)
+	{
+		return -1;
+	}
+	return spindle_bulk_checkpoint_(bulk, after[0] ? after : NULL, processed, failed, 1);
+}
+
+/* Give a worker process its own database and SPARQL connections */
+static int
+spindle_bulk_worker_connect_(struct spindle_bulk_struct *bulk)
+{
+	SPINDLE *spindle;
+
+	spindle = bulk->generate->spindle;
+	/* The inherited handles belong to the parent and must be left alone */
+	spindle->sparql = NULL;
+	if(spindle_db_reconnect(spindle) || !spindle->db)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": bulk: worker %d failed to connect to database\n", bulk->worker);
+		return -1;
+	}
+	spindle->sparql = twine_sparql_create();
+	if(!spindle->sparql)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": bulk: worker %d failed to create SPARQL connection\n", bulk->worker);
+		return -1;
+	}
+	bulk->generate->db = spindle->db;
+	bulk->generate->sparql = spindle->sparql;
+	return 0;
+}
+
+/* Fetch and process the next page of a worker's range; returns 1 if a page
+ * was processed, 0 if the range is exhausted, -1 on error
+ */
+static int
+spindle_bulk_page_(struct spindle_bulk_struct *bulk, const char *lower, const char *upper, char *after, unsigned long *processed, unsigned long *failed)
+{
+	SQL_STATEMENT *rs;
+	char **ids;
+	size_t c, count;
+	const char *t;
+
+	if(after[0])
+	{
+		rs = spindle_db_queryf(bulk->generate->db, "SELECT \"id\" FROM \"proxy\" WHERE \"id\" > %Q AND \"id\" <= %Q ORDER BY \"id\" LIMIT %d", after, upper, bulk->batch);
+	}
+	else
+	{
+		rs = spindle_db_queryf(bulk->generate->db, "SELECT \"id\" FROM \"proxy\" WHERE \"id\" >= %Q AND \"id\" <= %Q ORDER BY \"id\" LIMIT %d", lower, upper, bulk->batch);
+	}
+	if(!rs)
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": bulk: failed to query for item UUIDs\n");
+		return -1;
+	}
+	/* Copy the page so that the result set isn't held open while
+	 * generating
+	 */
+	ids = (char **) calloc(bulk->batch, sizeof(char *));
+	if(!ids)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": bulk: failed to allocate page buffer\n");
+		sql_stmt_destroy(rs);
+		return -1;
+	}
+	for(count = 0; count < (size_t) bulk->batch && !sql_stmt_eof(rs); sql_stmt_next(rs))
+	{
+		if(!(t = sql_stmt_str(rs, 0)) || !(ids[count] = strdup(t)))
+		{
+			twine_logf(LOG_ERR, PLUGIN_NAME ": bulk: failed to obtain UUID from database column\n");
+			continue;
+		}
+		count++;
+	}
+	sql_stmt_destroy(rs);
+	for(c = 0; c < count; c++)
+	{
+		twine_logf(LOG_DEBUG, PLUGIN_NAME ": will update {%s}\n", ids[c]);
+		if(spindle_generate(bulk->generate, ids[c], SF_NONE, SPINDLE_PRIO_BULK))
+		{
+			(*failed)++;
+			spindle_bulk_report_(bulk, ids[c], 1);
+		}
+		else
+		{
+			spindle_bulk_report_(bulk, ids[c], 0);
+		}
+		(*processed)++;
+	}
+	if(count)
+	{
+		strncpy(after, ids[count - 1], 39);
+		after[39] = 0;
+	}
+	for(c = 0; c < count; c++)
+	{
+		free(ids[c]);
+	}
+	free(ids);
+	return count ? 1 : 0;
+}
+
+/* Record a worker's position */
+static int
+spindle_bulk_checkpoint_(struct spindle_bulk_struct *bulk, const char *after, unsigned long processed, unsigned long failed, int complete)
+{
+	if(spindle_db_executef(bulk->generate->db, "UPDATE \"generate_checkpoint\" SET \"lastid\" = %Q, \"complete\" = %Q, \"processed\" = %lu, \"failed\" = %lu, \"modified\" = now() AT TIME ZONE 'UTC' WHERE \"workers\" = %d AND \"worker\" = %d",
+					after, (complete ? "t" : "f"), processed, failed, bulk->workers, bulk->worker))
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": bulk: failed to record checkpoint for worker %d\n", bulk->worker);
+		return -1;
+	}
+	return 0;
+}
+
+/* Report the outcome of generating a single entity */
+static int
+spindle_bulk_report_(struct spindle_bulk_struct *bulk, const char *id, int failed)
+{
+	char buf[64];
+	int l;
+
+	l = snprintf(buf, sizeof(buf), "%c %s\n", (failed ? 'F' : 'P'), id);
+	if(bulk->fd == -1)
+	{
+		buf[l - 1] = 0;
+		return spindle_bulk_tally_(bulk, buf);
+	}
+	/* Writes of less than PIPE_BUF bytes are atomic, so all of the workers
+	 * can share a single pipe
+	 */
+	if(write(bulk->fd, buf, l) != l)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+/* Aggregate a single progress report line */
+static int
+spindle_bulk_tally_(struct spindle_bulk_struct *bulk, const char *line)
+{
+	if(line[0] != 'P' && line[0] != 'F')
+	{
+		return 0;
+	}
+	bulk->processed++;
+	if(line[0] == 'F')
+	{
+		bulk->failed++;
+		if(line[1] == ' ')
+		{
+			spindle_strset_add(bulk->failures, &(line[2]));
+		}
+	}
+	return spindle_bulk_progress_(bulk, 0);
+}
+
+/* Log progress if the reporting interval has elapsed (or if final is set) */
+static int
+spindle_bulk_progress_(struct spindle_bulk_struct *bulk, int final)
+{
+	unsigned long long now;
+	double rate, total;
+	size_t c;
+
+	now = spindle_bulk_now_();
+	if(!final && (bulk->interval <= 0 || now - bulk->lastreport < (unsigned long long) bulk->interval * 1000))
+	{
+		return 0;
+	}
+	rate = 0;
+	if(now > bulk->lastreport)
+	{
+		rate = (double) (bulk->processed - bulk->lastprocessed) * 1000 / (double) (now - bulk->lastreport);
+	}
+	total = 0;
+	if(now > bulk->start)
+	{
+		total = (double) bulk->processed * 1000 / (double) (now - bulk->start);
+	}
+	if(final)
+	{
+		twine_logf(LOG_NOTICE, PLUGIN_NAME ": bulk: processed %lu proxies (%lu failed) in %.1fs, %.2f/sec\n", bulk->processed, bulk->failed, (double) (now - bulk->start) / 1000, total);
+		for(c = 0; c < bulk->failures->count; c++)
+		{
+			twine_logf(LOG_WARNING, PLUGIN_NAME ": bulk: failed to re-generate {%s}\n", bulk->failures->strings[c]);
+		}
+	}
+	else
+	{
+		twine_logf(LOG_NOTICE, PLUGIN_NAME ": bulk: processed %lu proxies (%lu failed), %.2f/sec (%.2f/sec overall)\n", bulk->processed, bulk->failed, rate, total);
+	}
+	bulk->lastreport = now;
+	bulk->lastprocessed = bulk->processed;
+	return 0;
+}
+
+/* Read progress reports from workers until they have all exited */
+static int
+spindle_bulk_collect_(struct spindle_bulk_struct *bulk, int fd)
+{
+	struct pollfd pfd;
+	char buf[4096], *p, *e;
+	size_t len;
+	ssize_t r;
+
+	len = 0;
+	for(;;)
+	{
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if(poll(&pfd, 1, 1000) < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+		if(!pfd.revents)
+		{
+			spindle_bulk_progress_(bulk, 0);
+			continue;
+		}
+		r = read(fd, &(buf[len]), sizeof(buf) - len - 1);
+		if(r < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(r <= 0)
+		{
+			break;
+		}
+		len += r;
+		buf[len] = 0;
+		for(p = buf; (e = strchr(p, '\n')); p = e + 1)
+		{
+			*e = 0;
+			spindle_bulk_tally_(bulk, p);
+		}
+		len -= (p - buf);
+		memmove(buf, p, len);
+	}
+	return 0;
+}
+
+/* Once every worker has completed its range, discard the checkpoints so
+ * that the next run starts from the beginning
+ */
+static int
+spindle_bulk_finish_(struct spindle_bulk_struct *bulk)
+{
+	SQL_STATEMENT *rs;
+
+	rs = spindle_db_queryf(bulk->generate->db, "SELECT \"worker\" FROM \"generate_checkpoint\" WHERE \"workers\" = %d AND NOT \"complete\"", bulk->workers);
+	if(!rs)
+	{
+		return -1;
+	}
+	if(!sql_stmt_eof(rs))
+	{
+		sql_stmt_destroy(rs);
+		twine_logf(LOG_WARNING, PLUGIN_NAME ": bulk: some workers did not complete; re-run to resume\n");
+		return -1;
+	}
+	sql_stmt_destroy(rs);
+	if(spindle_db_executef(bulk->generate->db, "DELETE FROM \"generate_checkpoint\" WHERE \"workers\" = %d", bulk->workers))
+	{
+		return -1;
+	}
+	return 0;
+}
+
+/* Determine the (inclusive) range of UUIDs processed by a worker */
+static void
+spindle_bulk_range_(int workers, int worker, char *lower, char *upper)
+{
+	unsigned long long lo, hi;
+
+	lo = (0x100000000ULL * worker) / workers;
+	hi = ((0x100000000ULL * (worker + 1)) / workers) - 1;
+	sprintf(lower, "%08llx-0000-0000-0000-000000000000", lo);
+	sprintf(upper, "%08llx-ffff-ffff-ffff-ffffffffffff", hi);
+}
+
+static unsigned long long
+spindle_bulk_now_(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return ((unsigned long long) tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+}
@@ -37,7 +37,7 @@ static int spindle_cache_init_file_(SPINDLEGENERATE *generate, const char *path)
 static int spindle_cache_store_s3_buf_(SPINDLEENTRY *data, const char *suffix, char *quadbuf, size_t bufsize);
 static int spindle_cache_store_file_buf_(SPINDLEENTRY *data, const char *suffix, char *quadbuf, size_t bufsize);
 static int spindle_cache_fetch_s3_(SPINDLEENTRY *data, const char *suffix, char **quadbuf, size_t *bufsize);
-static int spindle_cache_fetch_file_(SPINDLEENTRY *data, const char *suffix, char **quadbuf, size_t *bufsize);
+static int spindle_cache_fetch_file_(SPINDLEENTRY *data, const char *suffix, librdf_model *destmodel);
 static size_t spindle_cache_s3_upload_(char *buffer, size_t size, size_t nitems, void *userdata);
 static size_t spindle_cache_s3_download_(char *buffer, size_t size, size_t nitems, void *userdata);
 static char *spindle_cache_filename_(SPINDLEENTRY *data, const char *suffix);
@@ -129,7 +129,9 @@ spindle_cache_store_buf(SPINDLEENTRY *data, const char *suffix, char *quadbuf, s
 	return 0;
 }
 
-/* Retrieve N-Quads from the cache, if available */
+/* Retrieve N-Quads from the cache, if available, returning 1 if they were
+ * found, 0 if not, or -1 on error
+ */
 int
 spindle_cache_fetch(SPINDLEENTRY *data, const char *suffix, librdf_model *destmodel)
 {
@@ -145,17 +147,17 @@ spindle_cache_fetch(SPINDLEENTRY *data, const char *suffix, librdf_model *destmo
 	}
 	else if(data->generate->cachepath)
 	{
-		r = spindle_cache_fetch_file_(data, suffix, &buf, &bufsize);
+		return spindle_cache_fetch_file_(data, suffix, destmodel);
 	}
 	else
 	{
 		/* No cache available */
 		return 0;
 	}
-	if(r < 0)
+	if(r <= 0)
 	{
 		free(buf);
-		return -1;
+		return r;
 	}
 	if(bufsize)
 	{
@@ -341,8 +343,9 @@ spindle_cache_filename_(SPINDLEENTRY *data, const char *suffix)
 	size_t l;
 	const char *s;
 	char *path, *t;
+	int c;
 	
-	l = strlen(data->generate->cachepath) + strlen(data->localname) + 8;
+	l = strlen(data->generate->cachepath) + strlen(data->localname) + (data->generate->cacheshard * 3) + 8;
 	path = (char *) calloc(1, l);
 	if(!path)
 	{
@@ -358,6 +361,20 @@ spindle_cache_filename_(SPINDLEENTRY *data, const char *suffix)
 	{
 		s = (char *) data->localname;
 	}
+	/* Spread files across sub-directories named for successive pairs of
+	 * characters of the UUID, so that no single directory holds them all
+	 */
+	t = strchr(path, 0);
+	for(c = 0; c < data->generate->cacheshard && isxdigit((unsigned char) s[c * 2]) && isxdigit((unsigned char) s[c * 2 + 1]); c++)
+	{
+		*t = s[c * 2];
+		t++;
+		*t = s[c * 2 + 1];
+		t++;
+		*t = '/';
+		t++;
+	}
+	*t = 0;
 	strcat(path, s);
 	t = strchr(path, '#');
 	if(t)
@@ -378,77 +395,113 @@ spindle_cache_filename_(SPINDLEENTRY *data, const char *suffix)
 	return path;
 }
 
-/* Store pre-composed N-Quads in a file */
+/* Store pre-composed N-Quads in a file: the buffer is written in its
+ * entirety to a temporary file, which is then renamed into place, so that
+ * readers never see a partially-written file
+ */
 static int
 spindle_cache_store_file_buf_(SPINDLEENTRY *data, const char *suffix, char *quadbuf, size_t bufsize)
 {
-	FILE *f;
-	int r;
-	char *path;
+	char *path, *tmp, *t;
+	size_t len;
+	ssize_t r;
+	int fd;
 	
 	path = spindle_cache_filename_(data, suffix);
 	if(!path)
 	{
 		return -1;
 	}
-	f = fopen(path, "wb");
-	if(!f)
+	/* Create any sub-directories which don't yet exist */
+	len = strlen(data->generate->cachepath);
+	for(t = strchr(path + len, '/'); t; t = strchr(t + 1, '/'))
+	{
+		*t = 0;
+		if(mkdir(path, 0777) && errno != EEXIST)
+		{
+			twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to create cache directory: %s: %s\n", path, strerror(errno));
+			free(path);
+			return -1;
+		}
+		*t = '/';
+	}
+	tmp = (char *) malloc(strlen(path) + 32);
+	if(!tmp)
 	{
-		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to open cache file for writing: %s: %s\n", path, strerror(errno));
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate memory for temporary path buffer\n");
+		free(path);
+		return -1;
+	}
+	sprintf(tmp, "%s.%ld.tmp", path, (long) getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if(fd == -1)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to open cache file for writing: %s: %s\n", tmp, strerror(errno));
+		free(tmp);
 		free(path);
 		return -1;
 	}
 	r = 0;
 	while(bufsize)
 	{
-		if(bufsize > 1024)
-		{
-			if(fwrite(quadbuf, 1024, 1, f) != 1)
-			{
-				r = -1;
-				break;
-			}
-			quadbuf += 1024;
-			bufsize -= 1024;
-		}
-		else
+		r = write(fd, quadbuf, bufsize);
+		if(r < 0)
 		{
-			if(fwrite(quadbuf, bufsize, 1, f) != 1)
+			if(errno == EINTR)
 			{
-				r = -1;
-				break;
+				r = 0;
+				continue;
 			}
-			bufsize = 0;
+			break;
 		}
+		quadbuf += r;
+		bufsize -= r;
 	}
-	if(r)
+	if(r >= 0 && data->generate->cachesync && fdatasync(fd))
+	{
+		r = -1;
+	}
+	if(close(fd))
+	{
+		r = -1;
+	}
+	if(r < 0 || rename(tmp, path))
 	{
 		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to write to cache file: %s: %s\n", path, strerror(errno));
-		fclose(f);
+		unlink(tmp);
+		free(tmp);
 		free(path);
 		return -1;
 	}
-	fclose(f);
+	free(tmp);
 	free(path);
 	return 0;
 }
 
-/* Fetch a set of N-Quads from a file on disk */
+/* Fetch a set of N-Quads from a file on disk and parse them into
+ * destmodel. The file is read in its entirety with a single buffer, or, if
+ * spindle:cache-mmap is enabled, mapped into memory and parsed in place.
+ * Mapping is only safe if every process writing to the cache replaces files
+ * by renaming them, because a file truncated while it is mapped causes the
+ * reader to be killed with SIGBUS.
+ */
 static int
-spindle_cache_fetch_file_(SPINDLEENTRY *entry, const char *suffix, char **quadbuf, size_t *quadbuflen)
+spindle_cache_fetch_file_(SPINDLEENTRY *entry, const char *suffix, librdf_model *destmodel)
 {
-	char *path, *buffer, *p;
-	FILE *f;
-	size_t bufsize, buflen;
-	ssize_t r;
+	char *path, *buf;
+	struct stat sb;
+	void *map;
+	size_t len;
+	ssize_t n;
+	int fd, r;
 	
 	path = spindle_cache_filename_(entry, suffix);
 	if(!path)
 	{
 		return -1;
 	}
-	f = fopen(path, "rb");
-	if(!f)
+	fd = open(path, O_RDONLY);
+	if(fd == -1)
 	{
 		if(errno == ENOENT)
 		{
@@ -459,38 +512,85 @@ spindle_cache_fetch_file_(SPINDLEENTRY *entry, const char *suffix, char **quadbu
 		free(path);
 		return -1;
 	}
-	r = 0;
-	buffer = NULL;
-	bufsize = 0;
-	buflen = 0;
-	while(!feof(f))
+	if(fstat(fd, &sb))
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to obtain size of cache file: %s: %s\n", path, strerror(errno));
+		close(fd);
+		free(path);
+		return -1;
+	}
+	if(!sb.st_size)
+	{
+		/* The cached model is empty */
+		close(fd);
+		free(path);
+		return 1;
+	}
+	if(!entry->generate->cachemmap)
 	{
-		if(bufsize - buflen < 1024)
+		buf = (char *) malloc(sb.st_size);
+		if(!buf)
+		{
+			twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate %lu bytes for cache file: %s\n", (unsigned long) sb.st_size, path);
+			close(fd);
+			free(path);
+			return -1;
+		}
+		/* A file rewritten in place by an older writer may be shorter than
+		 * it was when its size was obtained
+		 */
+		n = 0;
+		for(len = 0; len < (size_t) sb.st_size; len += n)
 		{
-			p = (char *) realloc(buffer, bufsize + 1024);
-			if(!p)
+			n = read(fd, buf + len, sb.st_size - len);
+			if(n < 0 && errno == EINTR)
 			{
-				twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to reallocate buffer from %u bytes to %u bytes\n", (unsigned) bufsize, (unsigned) bufsize + 1024);
-				free(buffer);
-				return -1;
+				n = 0;
+				continue;
+			}
+			if(n <= 0)
+			{
+				break;
 			}
-			buffer = p;
-			bufsize += 1024;
 		}
-		r = fread(&(buffer[buflen]), 1, 1023, f);
-		if(r < 0)
+		if(n < 0)
 		{
-			twine_logf(LOG_CRIT, PLUGIN_NAME ": error reading from '%s': %s\n", path, strerror(errno));
-			free(buffer);
+			twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to read cache file: %s: %s\n", path, strerror(errno));
+			close(fd);
+			free(buf);
 			free(path);
 			return -1;
 		}
-		buflen += r;
-		buffer[buflen] = 0;
+		close(fd);
+		r = (len ? twine_rdf_model_parse(destmodel, MIME_NQUADS, buf, len) : 0);
+		free(buf);
+		if(r)
+		{
+			twine_logf(LOG_ERR, PLUGIN_NAME ": failed to parse cache file: %s\n", path);
+			free(path);
+			return -1;
+		}
+		free(path);
+		return 1;
 	}
-	fclose(f);
-	*quadbuf = buffer;
-	*quadbuflen = buflen;
+	map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to map cache file: %s: %s\n", path, strerror(errno));
+		free(path);
+		return -1;
+	}
+	madvise(map, sb.st_size, MADV_SEQUENTIAL);
+	r = twine_rdf_model_parse(destmodel, MIME_NQUADS, (const char *) map, sb.st_size);
+	munmap(map, sb.st_size);
+	if(r)
+	{
+		twine_logf(LOG_ERR, PLUGIN_NAME ": failed to parse cache file: %s\n", path);
+		free(path);
+		return -1;
+	}
+	free(path);
 	return 1;
 }
 
@@ -547,6 +647,17 @@ spindle_cache_init_file_(SPINDLEGENERATE *generate, const char *path)
 		return -1;
 	}
 	strcpy(generate->cachepath, path);
+	generate->cacheshard = twine_config_get_int(PLUGIN_NAME ":cache-shard", twine_config_get_int("spindle:cache-shard", 0));
+	if(generate->cacheshard < 0)
+	{
+		generate->cacheshard = 0;
+	}
+	if(generate->cacheshard > SPINDLE_CACHE_SHARD_MAX)
+	{
+		generate->cacheshard = SPINDLE_CACHE_SHARD_MAX;
+	}
+	generate->cachesync = twine_config_get_bool(PLUGIN_NAME ":cache-sync", twine_config_get_bool("spindle:cache-sync", 0));
+	generate->cachemmap = twine_config_get_bool(PLUGIN_NAME ":cache-mmap", twine_config_get_bool("spindle:cache-mmap", 0));
 	if(path[0])
 	{
 		t = strchr(generate->cachepath, 0);
@@ -23,6 +23,11 @@
 
 #include "p_spindle-generate.h"
 
+/* The number of source graphs whose descriptions are requested at once */
+#define DESCRIBE_BATCH_SIZE             16
+
+static int spindle_describe_graph_(SPINDLEENTRY *data, librdf_model *model, librdf_node *node);
+
 /* Cache information about the digital objects describing the entity */
 int
 spindle_describe_entry(SPINDLEENTRY *data)
@@ -30,9 +35,9 @@ spindle_describe_entry(SPINDLEENTRY *data)
 	librdf_model *model;
 	librdf_iterator *iter;
 	librdf_stream *stream;
-	librdf_node *node, *subject;
-	librdf_statement *st, *statement;
+	librdf_node *node, **graphs, **p;
 	const char *uri;
+	size_t c, n, size;
 	int r;
 
 	model = twine_rdf_model_create();
@@ -52,73 +57,58 @@ spindle_describe_entry(SPINDLEENTRY *data)
 	}
 	if(r == 0)
 	{
-		/* Find all of the triples related to all of the graphs describing
-		 * source data.
+		/* Collect all of the graphs describing source data, so that their
+		 * descriptions can be fetched in batches rather than one at a time
 		 */
+		graphs = NULL;
+		n = 0;
+		size = 0;
 		iter = librdf_model_get_contexts(data->sourcedata);
-		while(!librdf_iterator_end(iter))
+		for(; !librdf_iterator_end(iter); librdf_iterator_next(iter))
 		{
 			node = librdf_iterator_get_object(iter);
 			uri = (const char *) librdf_uri_as_string(librdf_node_get_uri(node));
 			if(!strncmp(uri, data->spindle->root, strlen(data->spindle->root)))
 			{
-				librdf_iterator_next(iter);
 				continue;
 			}
-			twine_logf(LOG_DEBUG, PLUGIN_NAME ": fetching information about graph <%s>\n", uri);
-			/* Fetch triples from graph G where the subject of each
-			 * triple is also graph G
-			 */
-			if(spindle_graphcache_description_node(data->spindle, data->sourcedata, node))
-			{
-				return -1;
-			}
-			/* Add triples, in our graph, stating that:
-			 *   ex:graphuri rdf:type foaf:Document .
-			 */
-			st = twine_rdf_st_create();
-			librdf_statement_set_subject(st, librdf_new_node_from_node(node));
-			librdf_statement_set_predicate(st, twine_rdf_node_createuri(NS_RDF "type"));
-			librdf_statement_set_object(st, twine_rdf_node_createuri(NS_FOAF "Document"));
-			twine_rdf_model_add_st(model, st, data->graph);
-			librdf_free_statement(st);
-		
-			/* For each subject in the graph, add triples stating that:
-			 *   ex:subject wdrs:describedby ex:graphuri .
-			 */
-			stream = librdf_model_context_as_stream(data->sourcedata, node);
-			for(; !librdf_stream_end(stream); librdf_stream_next(stream))
+			if(n + 1 > size)
 			{
-				statement = librdf_stream_get_object(stream);
-				subject = librdf_statement_get_subject(statement);
-				if(!librdf_node_is_resource(subject))
+				p = (librdf_node **) realloc(graphs, sizeof(librdf_node *) * (size + 16));
+				if(!p)
 				{
-					continue;
+					twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to expand list of source graphs\n");
+					r = -1;
+					break;
 				}
-				if(librdf_node_equals(node, subject))
-				{
-					continue;
-				}
-				st = twine_rdf_st_create();
-				librdf_statement_set_subject(st, librdf_new_node_from_node(subject));
-				librdf_statement_set_predicate(st, twine_rdf_node_createuri(NS_POWDER "describedby"));
-				librdf_statement_set_object(st, librdf_new_node_from_node(node));
-				twine_rdf_model_add_st(model, st, data->graph);
-				librdf_free_statement(st);
-
-				/* Add <doc> rdfs:seeAlso <source> */
-				st = twine_rdf_st_create();
-				librdf_statement_set_subject(st, librdf_new_node_from_node(data->doc));
-				librdf_statement_set_predicate(st, twine_rdf_node_createuri(NS_RDFS "seeAlso"));
-				librdf_statement_set_object(st, librdf_new_node_from_node(node));
-				twine_rdf_model_add_st(model, st, data->graph);
-				librdf_free_statement(st);
+				graphs = p;
+				size += 16;
 			}
-			librdf_free_stream(stream);
-
-			librdf_iterator_next(iter);
+			graphs[n] = librdf_new_node_from_node(node);
+			n++;
 		}
 		librdf_free_iterator(iter);
+		for(c = 0; !r && c < n; c++)
+		{
+			if(!(c % DESCRIBE_BATCH_SIZE))
+			{
+				/* Failure here isn't fatal: each graph will be fetched
+				 * individually instead
+				 */
+				spindle_graphcache_prefetch_descriptions(data->spindle, &(graphs[c]), (n - c < DESCRIBE_BATCH_SIZE ? n - c : DESCRIBE_BATCH_SIZE));
+			}
+			r = spindle_describe_graph_(data, model, graphs[c]);
+		}
+		for(c = 0; c < n; c++)
+		{
+			librdf_free_node(graphs[c]);
+		}
+		free(graphs);
+		if(r)
+		{
+			twine_rdf_model_destroy(model);
+			return -1;
+		}
 		spindle_cache_store(data, "graphs", model);
 	}
 	if(data->generate->describedby)
@@ -132,3 +122,64 @@ spindle_describe_entry(SPINDLEENTRY *data)
 }
 
 
+
+/* Add information about a single source graph to the model */
+static int
+spindle_describe_graph_(SPINDLEENTRY *data, librdf_model *model, librdf_node *node)
+{
+	librdf_stream *stream;
+	librdf_node *subject;
+	librdf_statement *st, *statement;
+
+	twine_logf(LOG_DEBUG, PLUGIN_NAME ": fetching information about graph <%s>\n", (const char *) librdf_uri_as_string(librdf_node_get_uri(node)));
+	/* Fetch triples from graph G where the subject of each
+	 * triple is also graph G
+	 */
+	if(spindle_graphcache_description_node(data->spindle, data->sourcedata, node))
+	{
+		return -1;
+	}
+	/* Add triples, in our graph, stating that:
+	 *   ex:graphuri rdf:type foaf:Document .
+	 */
+	st = twine_rdf_st_create();
+	librdf_statement_set_subject(st, librdf_new_node_from_node(node));
+	librdf_statement_set_predicate(st, twine_rdf_node_createuri(NS_RDF "type"));
+	librdf_statement_set_object(st, twine_rdf_node_createuri(NS_FOAF "Document"));
+	twine_rdf_model_add_st(model, st, data->graph);
+	librdf_free_statement(st);
+
+	/* For each subject in the graph, add triples stating that:
+	 *   ex:subject wdrs:describedby ex:graphuri .
+	 */
+	stream = librdf_model_context_as_stream(data->sourcedata, node);
+	for(; !librdf_stream_end(stream); librdf_stream_next(stream))
+	{
+		statement = librdf_stream_get_object(stream);
+		subject = librdf_statement_get_subject(statement);
+		if(!librdf_node_is_resource(subject))
+		{
+			continue;
+		}
+		if(librdf_node_equals(node, subject))
+		{
+			continue;
+		}
+		st = twine_rdf_st_create();
+		librdf_statement_set_subject(st, librdf_new_node_from_node(subject));
+		librdf_statement_set_predicate(st, twine_rdf_node_createuri(NS_POWDER "describedby"));
+		librdf_statement_set_object(st, librdf_new_node_from_node(node));
+		twine_rdf_model_add_st(model, st, data->graph);
+		librdf_free_statement(st);
+
+		/* Add <doc> rdfs:seeAlso <source> */
+		st = twine_rdf_st_create();
+		librdf_statement_set_subject(st, librdf_new_node_from_node(data->doc));
+		librdf_statement_set_predicate(st, twine_rdf_node_createuri(NS_RDFS "seeAlso"));
+		librdf_statement_set_object(st, librdf_new_node_from_node(node));
+		twine_rdf_model_add_st(model, st, data->graph);
+		librdf_free_statement(st);
+	}
+	librdf_free_stream(stream);
+	return 0;
+}
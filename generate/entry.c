@@ -162,6 +162,10 @@ spindle_entry_cleanup(SPINDLEENTRY *data)
 	{
 		spindle_proxy_refs_destroy(data->refs);
 	}
+	if(data->refset)
+	{
+		spindle_strset_destroy(data->refset);
+	}
 	if(data->doc)
 	{
 		librdf_free_node(data->doc);
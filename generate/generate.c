@@ -36,8 +36,7 @@ static int spindle_generate_state_update_(SPINDLEENTRY *cache);
 static int spindle_generate_txn_(SQL *restrict sql, void *restrict userdata);
 static int spindle_generate_entry_(SPINDLEENTRY *entry);
 
-static unsigned long long gettimems(void);
-static int gettimediffms(unsigned long long *start);
+static void spindle_generate_timing_(SPINDLEENTRY *entry, int stage, unsigned long long *start);
 
 /* Generate the data for a single entity, given an identifier
  *
@@ -46,9 +45,12 @@ static int gettimediffms(unsigned long long *start);
  * - A local URI
  * - A UUID
  * - An external URI, which needs to be looked up
+ *
+ * If priority is SPINDLE_PRIO_NONE, the priority recorded in the state
+ * table (if any) is used.
  */
 int
-spindle_generate(SPINDLEGENERATE *generate, const char *identifier, int mode)
+spindle_generate(SPINDLEGENERATE *generate, const char *identifier, int mode, int priority)
 {
 	SPINDLEENTRY data;
 	char *idbuf;
@@ -62,23 +64,34 @@ spindle_generate(SPINDLEGENERATE *generate, const char *identifier, int mode)
 		twine_logf(LOG_ERR, PLUGIN_NAME ": failed to determine identifier for <%s>\n", identifier);
 		return -1;
 	}
+	/* Don't use cached copies of source graphs which have since changed */
+	if(spindle_db_graph_sync(generate->spindle))
+	{
+		twine_logf(LOG_WARNING, PLUGIN_NAME ": failed to check for changed source graphs; cached copies of them may be stale\n");
+	}
 	r = 0;
 	if(spindle_entry_init(&data, generate, idbuf))
 	{
 		r = -1;
 	}
-	else if(data.db)
+	else
 	{
-		if(sql_perform(data.db, spindle_generate_txn_, (void *) &data, -1, SQL_TXN_CONSISTENT))
+		data.priority = priority;
+		if(data.db)
 		{
-			r = -1;
+			if(spindle_db_perform(generate->spindle, data.db, spindle_generate_txn_, (void *) &data, SQL_TXN_CONSISTENT))
+			{
+				r = -1;
+			}
+		}
+		else
+		{
+			r = spindle_generate_entry_(&data);
 		}
-	}
-	else
-	{
-		r = spindle_generate_entry_(&data);
 	}
 	spindle_entry_cleanup(&data);
+	spindle_stats_entity(generate->spindle, r);
+	spindle_stats_flush(generate->spindle, 0);
 	if(r)
 	{
 		twine_logf(LOG_ERR, PLUGIN_NAME ": update failed for <%s>\n", idbuf);
@@ -91,28 +104,6 @@ spindle_generate(SPINDLEGENERATE *generate, const char *identifier, int mode)
 	return r;	
 }
 
-static unsigned long long
-gettimems(void)
-{
-	struct timeval tv;
-
-	gettimeofday(&tv, NULL);
-	return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
-}
-
-static int
-gettimediffms(unsigned long long *start)
-{
-	struct timeval tv;
-	int r;
-
-	gettimeofday(&tv, NULL);
-	r = (int) (((tv.tv_sec * 1000) + (tv.tv_usec / 1000)) - *start);
-/*	*start = (tv.tv_sec * 1000) + (tv.tv_usec / 1000); */
-	return r;
-}
-
-
 static char *
 spindle_generate_uri_(SPINDLEGENERATE *generate, const char *identifier)
 {
@@ -228,11 +219,12 @@ spindle_generate_txn_(SQL *restrict sql, void *restrict userdata)
 static int
 spindle_generate_entry_(SPINDLEENTRY *entry)
 {
-	unsigned long long start;
+	unsigned long long start, step;
 
 	twine_logf(LOG_INFO, PLUGIN_NAME ": updating <%s>\n", entry->localname);
 	/* Obtain cached source data */
-	start = gettimems();
+	start = spindle_stats_clock();
+	step = start;
 	/* TODO: when performing a partial update, what sort of data do we need to retrieve in order for indexing to work correctly? */
 	/* TODO: can we use the cache? */
 	if(spindle_generate_state_fetch_(entry))
@@ -240,83 +232,98 @@ spindle_generate_entry_(SPINDLEENTRY *entry)
 		twine_logf(LOG_ERR, PLUGIN_NAME ": failed to retrieve entity state\n");
 		return -1;
 	}
-	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%dms] retrieve state\n", gettimediffms(&start));
+	spindle_generate_timing_(entry, SPINDLE_STAGE_STATE, &step);
 	if(spindle_source_fetch_entry(entry))
 	{
 		twine_logf(LOG_ERR, PLUGIN_NAME ": failed to obtain cached data from store\n");
 		return -1;
 	}
-	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%dms] obtain cached data\n", gettimediffms(&start));
+	spindle_generate_timing_(entry, SPINDLE_STAGE_SOURCE, &step);
 	/* Update any triggers */
 	if(spindle_triggers_update(entry) < 0)
 	{
 		return -1;
 	}
-	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%dms] update triggers\n", gettimediffms(&start));
+	spindle_generate_timing_(entry, SPINDLE_STAGE_TRIGGERS, &step);
 	/* Update proxy classes */
 	if(spindle_class_update_entry(entry) < 0)
 	{
 		return -1;
 	}
-	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%dms] update classes\n", gettimediffms(&start));
+	spindle_generate_timing_(entry, SPINDLE_STAGE_CLASSES, &step);
 	/* Update proxy properties */
 	if(spindle_prop_update_entry(entry) < 0)
 	{
 		return -1;
 	}
-	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%dms] update properties\n", gettimediffms(&start));
+	spindle_generate_timing_(entry, SPINDLE_STAGE_PROPS, &step);
 	/* Fetch information about the documents describing the entities */
 	if(spindle_describe_entry(entry) < 0)
 	{
 		return -1;
 	}
-	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%dms] update describedBy\n", gettimediffms(&start));
+	spindle_generate_timing_(entry, SPINDLE_STAGE_DESCRIBE, &step);
 	/* Describe the document itself */
 	if(spindle_doc_apply(entry) < 0)
 	{
 		return -1;
 	}
-	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%dms] add information resource\n", gettimediffms(&start));
+	spindle_generate_timing_(entry, SPINDLE_STAGE_DOC, &step);
 	/* Describing licensing information */
 	if(spindle_license_apply(entry) < 0)
 	{
 		return -1;
 	}
-	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%dms] add licensing information\n", gettimediffms(&start));
+	spindle_generate_timing_(entry, SPINDLE_STAGE_LICENSE, &step);
 	/* Fetch data about related resources */
 	if(spindle_related_fetch_entry(entry) < 0)
 	{
 		return -1;
 	}
-	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%dms] fetch related data\n", gettimediffms(&start));
+	spindle_generate_timing_(entry, SPINDLE_STAGE_RELATED, &step);
 	/* Index the resulting model */
 	if(spindle_index_entry(entry) < 0)
 	{
 		return -1;
 	}
-	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%dms] index generated entry\n", gettimediffms(&start));
+	spindle_generate_timing_(entry, SPINDLE_STAGE_INDEX, &step);
 	/* Store the resulting model */
 	if(spindle_store_entry(entry) < 0)
 	{
 		return -1;
 	}
-	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%dms] store generated entry\n", gettimediffms(&start));
+	spindle_generate_timing_(entry, SPINDLE_STAGE_STORE, &step);
 	/* Update the state of the entry */
 	if(spindle_generate_state_update_(entry) < 0)
 	{
 		return -1;
 	}
-	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%dms] update entry state\n", gettimediffms(&start));
+	spindle_generate_timing_(entry, SPINDLE_STAGE_UPDATE, &step);
 	/* Apply the triggers to update the state of target entries */
 	if(spindle_trigger_apply(entry) < 0)
 	{
 		return -1;
 	}
-	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%dms] apply triggers\n", gettimediffms(&start));
+	spindle_generate_timing_(entry, SPINDLE_STAGE_APPLY, &step);
+	spindle_generate_timing_(entry, SPINDLE_STAGE_TOTAL, &start);
 	twine_logf(LOG_DEBUG, PLUGIN_NAME ": generation complete for <%s>\n", entry->localname);
 	return 0;
 }
 
+/* Record the time taken by a stage of generation, which began at *start,
+ * and reset *start to the current time
+ */
+static void
+spindle_generate_timing_(SPINDLEENTRY *entry, int stage, unsigned long long *start)
+{
+	unsigned long long now;
+
+	now = spindle_stats_clock();
+	spindle_stats_stage(entry->spindle, stage, now - *start);
+	twine_logf(LOG_DEBUG, PLUGIN_NAME ": [%lums] %s\n", (unsigned long) ((now - *start) / 1000), spindle_stats_stage_name(stage));
+	*start = now;
+}
+
 static int
 spindle_generate_state_fetch_(SPINDLEENTRY *cache)
 {
@@ -331,11 +338,12 @@ spindle_generate_state_fetch_(SPINDLEENTRY *cache)
 		cache->flags = -1;
 		return 0;
 	}
-	rs = sql_queryf(cache->db, "SELECT \"status\", \"modified\", \"flags\" FROM \"state\" WHERE \"id\" = %Q", cache->id);
+	rs = spindle_db_queryf(cache->db, "SELECT \"status\", \"modified\", \"flags\", \"priority\", \"epoch\" FROM \"state\" WHERE \"id\" = %Q", cache->id);
 	if(!rs)
 	{
 		return -1;
 	}
+	spindle_querystats_rows(cache->spindle, sql_stmt_eof(rs) ? 0 : 1);
 	if(sql_stmt_eof(rs))
 	{
 		twine_logf(LOG_WARNING, PLUGIN_NAME ": no state entry exists for <%s>\n", cache->localname);
@@ -346,6 +354,11 @@ spindle_generate_state_fetch_(SPINDLEENTRY *cache)
 	state = sql_stmt_str(rs, 0);
 	modified = sql_stmt_str(rs, 1);
 	flags = (int) sql_stmt_long(rs, 2);
+	if(!cache->priority)
+	{
+		cache->priority = (int) sql_stmt_long(rs, 3);
+	}
+	cache->epoch = sql_stmt_long(rs, 4);
 	if(!state || !strcmp(state, "CLEAN") || !flags)
 	{
 		flags = -1;
@@ -366,9 +379,23 @@ spindle_generate_state_fetch_(SPINDLEENTRY *cache)
 	return 0;
 }
 
+/* Mark the entry as complete, unless it was dirtied again while we were
+ * generating it, in which case it is re-queued (keeping the accumulated
+ * flags) once the debounce interval has passed
+ */
 static int
 spindle_generate_state_update_(SPINDLEENTRY *cache)
 {
-	return sql_executef(cache->db, "UPDATE \"state\" SET \"status\" = %Q, \"flags\" = '%d' WHERE \"id\" = %Q", "COMPLETE", 0, cache->id);
+	return spindle_db_executef(cache->db, "UPDATE \"state\" SET "
+		"\"status\" = CASE WHEN \"epoch\" = %ld THEN %Q ELSE %Q END, "
+		"\"flags\" = CASE WHEN \"epoch\" = %ld THEN 0 ELSE \"flags\" END, "
+		"\"queued\" = CASE WHEN \"epoch\" = %ld THEN \"queued\" ELSE (now() AT TIME ZONE 'UTC') + interval '%d seconds' END, "
+		"\"generated\" = now() AT TIME ZONE 'UTC', "
+		"\"leased\" = NULL "
+		"WHERE \"id\" = %Q",
+		cache->epoch, "COMPLETE", "DIRTY",
+		cache->epoch,
+		cache->epoch, cache->spindle->debounce,
+		cache->id);
 }
 
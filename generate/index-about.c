@@ -59,7 +59,7 @@ spindle_index_about(SQL *sql, const char *id, SPINDLEENTRY *data)
 		/* Force a Creative Work entity to always 'about' itself, so that queries match both
 		 * topics and the works about those topics
 		 */
-		if(sql_executef(sql, "INSERT INTO \"about\" (\"id\", \"about\") VALUES (%Q, %Q)", id, id))
+		if(spindle_db_executef(sql, "INSERT INTO \"about\" (\"id\", \"about\") VALUES (%Q, %Q)", id, id))
 		{
 			return -1;
 		}
@@ -117,7 +117,7 @@ spindle_index_about(SQL *sql, const char *id, SPINDLEENTRY *data)
 				free(tid);
 				continue;
 			}
-			if(sql_executef(sql, "INSERT INTO \"about\" (\"id\", \"about\") VALUES (%Q, %Q)", id, tid))
+			if(spindle_db_executef(sql, "INSERT INTO \"about\" (\"id\", \"about\") VALUES (%Q, %Q)", id, tid))
 			{
 				free(tid);
 				r = -1;
@@ -23,6 +23,9 @@
 
 #include "p_spindle-generate.h"
 
+/* The number of same-origin graphs whose contents are fetched at once */
+#define AUDIENCES_BATCH_SIZE            8
+
 static char *spindle_index_audiences_origin_(const char *uristr);
 static int spindle_index_audiences_interp_(SPINDLEGENERATE *generate, librdf_model *model, librdf_node *subject, struct spindle_strset_struct *audiences);
 static int spindle_index_audiences_permission_(SPINDLEGENERATE *generate, librdf_model *model, librdf_node *subject, struct spindle_strset_struct *audiences);
@@ -50,7 +53,7 @@ spindle_index_audiences(SPINDLEGENERATE *generate, const char *license, const ch
 		return -1;
 	}
 	free(uri);
-	rs = sql_queryf(generate->spindle->db, "SELECT \"uri\", \"audienceid\" FROM \"licenses_audiences\" WHERE \"id\" = %Q", id);
+	rs = spindle_db_queryf(generate->spindle->db, "SELECT \"uri\", \"audienceid\" FROM \"licenses_audiences\" WHERE \"id\" = %Q", id);
 	free(id);
 	if(sql_stmt_eof(rs))
 	{
@@ -60,7 +63,7 @@ spindle_index_audiences(SPINDLEGENERATE *generate, const char *license, const ch
 	}
 	for(; !sql_stmt_eof(rs); sql_stmt_next(rs))
 	{
-		sql_executef(generate->spindle->db, "INSERT INTO \"media\" (\"id\", \"uri\", \"class\", \"type\", \"audience\", \"audienceid\", \"duration\") VALUES (%Q, %Q, %Q, %Q, %Q, %Q, %Q)",
+		spindle_db_executef(generate->spindle->db, "INSERT INTO \"media\" (\"id\", \"uri\", \"class\", \"type\", \"audience\", \"audienceid\", \"duration\") VALUES (%Q, %Q, %Q, %Q, %Q, %Q, %Q)",
 					 mediaid, mediauri, mediakind, mediatype, sql_stmt_str(rs, 0), 
 					 sql_stmt_str(rs, 1), duration);
 	}
@@ -77,14 +80,14 @@ int
 spindle_index_audiences_licence(SQL *sql, const char *id, SPINDLEENTRY *data)
 {
 	librdf_iterator *iter;
-	librdf_node *graph, *node;
+	librdf_node *graph, *node, **graphs, **p;
 	librdf_uri *graphuri;
 	librdf_model *model;
 	const char *graphuristr;
 	char *base, *audienceuri, *audienceid;
 	int r, match;
-	char **bases;
-	size_t c, d;
+	char **bases, **gbases, **q;
+	size_t c, d, g, ngraphs, size;
 	struct spindle_strset_struct *audiences;
 	SQL_STATEMENT *rs;
 	
@@ -127,9 +130,16 @@ spindle_index_audiences_licence(SQL *sql, const char *id, SPINDLEENTRY *data)
 		spindle_strset_destroy(audiences);
 		return -1;
 	}
-	/* Next, iterate all of the graphs in the source data we have */
+	/* Next, collect all of the graphs in the source data we have which pass
+	 * a same-origin test, so that their contents can be fetched in batches
+	 * rather than one at a time
+	 */
+	graphs = NULL;
+	gbases = NULL;
+	ngraphs = 0;
+	size = 0;
 	for(iter = librdf_model_get_contexts(data->sourcedata);
-		!librdf_iterator_end(iter);
+		!r && !librdf_iterator_end(iter);
 		librdf_iterator_next(iter))
 	{
 		graph = librdf_iterator_get_object(iter);
@@ -166,6 +176,42 @@ spindle_index_audiences_licence(SQL *sql, const char *id, SPINDLEENTRY *data)
 			continue;
 		}
 		twine_logf(LOG_DEBUG, PLUGIN_NAME ": graph <%s> passes same-origin check\n", graphuristr);
+		if(ngraphs + 1 > size)
+		{
+			p = (librdf_node **) realloc(graphs, sizeof(librdf_node *) * (size + 16));
+			if(p)
+			{
+				graphs = p;
+				q = (char **) realloc(gbases, sizeof(char *) * (size + 16));
+			}
+			if(!p || !q)
+			{
+				twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to expand list of same-origin graphs\n");
+				free(base);
+				r = -1;
+				break;
+			}
+			gbases = q;
+			size += 16;
+		}
+		graphs[ngraphs] = librdf_new_node_from_node(graph);
+		gbases[ngraphs] = base;
+		ngraphs++;
+	}
+	librdf_free_iterator(iter);
+	/* Walk each of the same-origin graphs in turn */
+	for(g = 0; r != 1 && g < ngraphs; g++)
+	{
+		graph = graphs[g];
+		base = gbases[g];
+		graphuristr = (const char *) librdf_uri_as_string(librdf_node_get_uri(graph));
+		if(!(g % AUDIENCES_BATCH_SIZE))
+		{
+			/* Failure here isn't fatal: each graph will be fetched
+			 * individually instead
+			 */
+			spindle_graphcache_prefetch_graphs(data->spindle, &(graphs[g]), (ngraphs - g < AUDIENCES_BATCH_SIZE ? ngraphs - g : AUDIENCES_BATCH_SIZE));
+		}
 		/* Fetch the contents of the graph so that we can walk it */
 		if((model = spindle_graphcache_fetch_node(data->spindle, graph)))
 		{
@@ -200,12 +246,14 @@ spindle_index_audiences_licence(SQL *sql, const char *id, SPINDLEENTRY *data)
 			twine_logf(LOG_ERR, PLUGIN_NAME ": failed fetch graph <%s>\n", graphuristr);
 			r = -1;
 		}
-		free(base);
-		if(r == 1)
-		{
-			break;
-		}
 	}
+	for(g = 0; g < ngraphs; g++)
+	{
+		librdf_free_node(graphs[g]);
+		free(gbases[g]);
+	}
+	free(graphs);
+	free(gbases);
 	if(r == 0)
 	{
 		for(c = 0; c < audiences->count; c++)
@@ -222,12 +270,12 @@ spindle_index_audiences_licence(SQL *sql, const char *id, SPINDLEENTRY *data)
 			free(audienceuri);
 			if(audienceid)
 			{
-				rs = sql_queryf(sql, "SELECT \"id\" FROM \"audiences\" WHERE \"id\" = %Q", audienceid);
+				rs = spindle_db_queryf(sql, "SELECT \"id\" FROM \"audiences\" WHERE \"id\" = %Q", audienceid);
 				if(rs)
 				{
 					if(sql_stmt_eof(rs))
 					{
-						sql_executef(sql, "INSERT INTO \"audiences\" (\"id\", \"uri\") VALUES (%Q, %Q)", audienceid, audiences->strings[c]);
+						spindle_db_executef(sql, "INSERT INTO \"audiences\" (\"id\", \"uri\") VALUES (%Q, %Q)", audienceid, audiences->strings[c]);
 					}
 					sql_stmt_destroy(rs);
 				}
@@ -236,7 +284,7 @@ spindle_index_audiences_licence(SQL *sql, const char *id, SPINDLEENTRY *data)
 					r = -1;
 				}
 			}
-			if(sql_executef(data->generate->db, "INSERT INTO \"licenses_audiences\" (\"id\", \"uri\", \"audienceid\") VALUES (%Q, %Q, %Q)",
+			if(spindle_db_executef(data->generate->db, "INSERT INTO \"licenses_audiences\" (\"id\", \"uri\", \"audienceid\") VALUES (%Q, %Q, %Q)",
 				data->id, audiences->strings[c], audienceid))
 			{
 				r = -1;
@@ -262,7 +310,6 @@ spindle_index_audiences_licence(SQL *sql, const char *id, SPINDLEENTRY *data)
 		free(bases[c]);
 	}
 	free(bases);
-	librdf_free_iterator(iter);
 	return r;
 }
 
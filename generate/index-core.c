@@ -74,7 +74,7 @@ spindle_index_core(SQL *sql, const char *id, SPINDLEENTRY *data)
 	{
 		t = NULL;
 	}
-	r = sql_executef(sql, "INSERT INTO \"index\" (\"id\", \"version\", \"modified\", \"score\", \"title\", \"description\", \"coordinates\", \"classes\") VALUES (%Q, %d, now(), %d, %Q, %Q, %Q, %Q)",
+	r = spindle_db_executef(sql, "INSERT INTO \"index\" (\"id\", \"version\", \"modified\", \"score\", \"title\", \"description\", \"coordinates\", \"classes\") VALUES (%Q, %d, now(), %d, %Q, %Q, %Q, %Q)",
 					 id, SPINDLE_DB_INDEX_VERSION, data->score, title, desc, t, classes);
 	
 	free(title);
@@ -112,7 +112,7 @@ spindle_index_updatelang_(SQL *sql, const char *id, const char *target, const ch
 {
 	if(specific)
 	{
-		if(sql_executef(sql, "UPDATE \"index\" SET "
+		if(spindle_db_executef(sql, "UPDATE \"index\" SET "
 						"\"index_%s\" = setweight(to_tsvector(coalesce(\"title\" -> '%s', \"title\" -> '%s', \"title\" -> '_', '')), 'A') || "
 						" setweight(to_tsvector(coalesce(\"description\" -> '%s', \"description\" -> '%s', \"description\" -> '_', '')), 'B')  "
 						"WHERE \"id\" = %Q", target, specific, generic, specific, generic, id))
@@ -121,7 +121,7 @@ spindle_index_updatelang_(SQL *sql, const char *id, const char *target, const ch
 		}
 		return 0;
 	}
-	if(sql_executef(sql, "UPDATE \"index\" SET "
+	if(spindle_db_executef(sql, "UPDATE \"index\" SET "
 					"\"index_%s\" = setweight(to_tsvector(coalesce(\"title\" -> '%s', \"title\" -> '_', '')), 'A') || "
 					" setweight(to_tsvector(coalesce(\"description\" -> '%s', \"description\" -> '_', '')), 'B')  "
 					"WHERE \"id\" = %Q", target, generic, generic, id))
@@ -100,13 +100,13 @@ spindle_index_media(SQL *sql, const char *id, SPINDLEENTRY *data)
 	else
 	{
 		twine_logf(LOG_DEBUG, PLUGIN_NAME ": media: <%s> has no license associated with it\n", refs[0]);
-		r = sql_executef(sql, "INSERT INTO \"media\" (\"id\", \"uri\", \"class\", \"type\", \"audience\", \"duration\") VALUES (%Q, %Q, %Q, %Q, %Q, %Q)",
+		r = spindle_db_executef(sql, "INSERT INTO \"media\" (\"id\", \"uri\", \"class\", \"type\", \"audience\", \"duration\") VALUES (%Q, %Q, %Q, %Q, %Q, %Q)",
 						 id, refs[0], kind, type, NULL, duration);
 	}
 #if SPINDLE_ENABLE_ABOUT_SELF
 	if(r >= 0)
 	{
-		r = sql_executef(sql, "INSERT INTO \"index_media\" (\"id\", \"media\") VALUES (%Q, %Q)", id, id);
+		r = spindle_db_executef(sql, "INSERT INTO \"index_media\" (\"id\", \"media\") VALUES (%Q, %Q)", id, id);
 	}
 #endif
 	free(refs[0]);
@@ -178,7 +178,7 @@ spindle_index_media_refs_(SQL *sql, const char *id, SPINDLEENTRY *data)
 			continue;
 		}
 		spindle_trigger_add(data, uristr, TK_MEDIA, tid);
-		if(sql_executef(sql, "INSERT INTO \"index_media\" (\"id\", \"media\") VALUES (%Q, %Q)", id, tid))
+		if(spindle_db_executef(sql, "INSERT INTO \"index_media\" (\"id\", \"media\") VALUES (%Q, %Q)", id, tid))
 		{
 			free(tid);
 			free(localid);
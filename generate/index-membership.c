@@ -83,8 +83,7 @@ spindle_index_membership_query_(SQL *sql, const char *id, SPINDLEENTRY *data, li
 	librdf_stream *stream;
 	librdf_uri *uri;
 	const char *uristr;
-	size_t c;
-	int r, match;	
+	int r;
 
 	if(!graph)
 	{
@@ -159,16 +158,7 @@ spindle_index_membership_query_(SQL *sql, const char *id, SPINDLEENTRY *data, li
 			   (uri = librdf_node_get_uri(node)) &&
 			   (uristr = (const char *) librdf_uri_as_string(uri)))
 			{
-				match = 0;
-				for(c = 0; data->refs[c]; c++)
-				{
-					if(!strcmp(uristr, data->refs[c]))
-					{
-						match = 1;
-						break;
-					}
-				}
-				if(!match)
+				if(!data->refset || !spindle_strset_contains(data->refset, uristr))
 				{
 					continue;
 				}
@@ -276,7 +266,7 @@ spindle_index_membership_add_(SQL *sql, const char *id, const char *collid)
 	SQL_STATEMENT *rs;
 
 	// Check if the relation is already there
-	rs = sql_queryf(sql, "SELECT \"id\" FROM \"membership\" WHERE \"id\" = %Q AND \"collection\" = %Q", id, collid);
+	rs = spindle_db_queryf(sql, "SELECT \"id\" FROM \"membership\" WHERE \"id\" = %Q AND \"collection\" = %Q", id, collid);
 	if(!rs)
 	{
 		return -1;
@@ -289,7 +279,7 @@ spindle_index_membership_add_(SQL *sql, const char *id, const char *collid)
 	sql_stmt_destroy(rs);
 
 	 // Ensure we won't create a loop by adding it.
-	rs = sql_queryf(sql, "SELECT \"id\" FROM \"membership\" WHERE \"id\" = %Q AND \"collection\" = %Q", collid, id);
+	rs = spindle_db_queryf(sql, "SELECT \"id\" FROM \"membership\" WHERE \"id\" = %Q AND \"collection\" = %Q", collid, id);
 	if(!rs)
 	{
 		return -1;
@@ -302,13 +292,13 @@ spindle_index_membership_add_(SQL *sql, const char *id, const char *collid)
 	sql_stmt_destroy(rs);
 
 	// Add the direct relation
-	if(sql_executef(sql, "INSERT INTO \"membership\" (\"id\", \"collection\") VALUES (%Q, %Q)", id, collid))
+	if(spindle_db_executef(sql, "INSERT INTO \"membership\" (\"id\", \"collection\") VALUES (%Q, %Q)", id, collid))
 	{
 		return -1;
 	}
 
 	// Recursively add all the membership
-	rs = sql_queryf(sql, "SELECT \"collection\" FROM \"membership\" WHERE \"id\" = %Q", collid);
+	rs = spindle_db_queryf(sql, "SELECT \"collection\" FROM \"membership\" WHERE \"id\" = %Q", collid);
 	if(!rs)
 	{
 		return -1;
@@ -88,12 +88,12 @@ spindle_index_remove_(SQL *sql, const char *id, SPINDLEENTRY *data)
 {
 	if(data->flags & TK_PROXY)
 	{
-		if(sql_executef(sql, "DELETE FROM \"index\" WHERE \"id\" = %Q",
+		if(spindle_db_executef(sql, "DELETE FROM \"index\" WHERE \"id\" = %Q",
 			id))
 		{
 			return -1;
 		}
-		if(sql_executef(sql, "DELETE FROM \"licenses_audiences\" WHERE \"id\" = %Q",
+		if(spindle_db_executef(sql, "DELETE FROM \"licenses_audiences\" WHERE \"id\" = %Q",
 			id))
 		{
 			return -1;
@@ -101,7 +101,7 @@ spindle_index_remove_(SQL *sql, const char *id, SPINDLEENTRY *data)
 	}
 	if(data->flags & TK_TOPICS)
 	{
-		if(sql_executef(sql, "DELETE FROM \"about\" WHERE \"id\" = %Q",
+		if(spindle_db_executef(sql, "DELETE FROM \"about\" WHERE \"id\" = %Q",
 			id))
 		{
 			return -1;
@@ -109,12 +109,12 @@ spindle_index_remove_(SQL *sql, const char *id, SPINDLEENTRY *data)
 	}
 	if(data->flags & TK_MEDIA)
 	{
-		if(sql_executef(sql, "DELETE FROM \"media\" WHERE \"id\" = %Q",
+		if(spindle_db_executef(sql, "DELETE FROM \"media\" WHERE \"id\" = %Q",
 			id))
 		{
 			return -1;
 		}
-		if(sql_executef(sql, "DELETE FROM \"index_media\" WHERE \"id\" = %Q",
+		if(spindle_db_executef(sql, "DELETE FROM \"index_media\" WHERE \"id\" = %Q",
 			id))
 		{
 			return -1;
@@ -122,7 +122,7 @@ spindle_index_remove_(SQL *sql, const char *id, SPINDLEENTRY *data)
 	}
 	if(data->flags & TK_MEMBERSHIP)
 	{
-		if(sql_executef(sql, "DELETE FROM \"membership\" WHERE \"id\" = %Q",
+		if(spindle_db_executef(sql, "DELETE FROM \"membership\" WHERE \"id\" = %Q",
 			id))
 		{
 			return -1;
@@ -130,7 +130,7 @@ spindle_index_remove_(SQL *sql, const char *id, SPINDLEENTRY *data)
 	}
 	if(data->flags == -1)
 	{
-		if(sql_executef(sql, "DELETE FROM \"triggers\" WHERE \"id\" = %Q",
+		if(spindle_db_executef(sql, "DELETE FROM \"triggers\" WHERE \"id\" = %Q",
 			id))
 		{
 			return -1;
@@ -75,7 +75,11 @@ spindle_generate_init_(SPINDLEGENERATE *generate)
 		spindle_rulebase_destroy(spindle.rules);
 		return -1;
 	}
-	spindle_rulebase_finalise(spindle.rules);
+	if(spindle_rulebase_finalise(spindle.rules))
+	{
+		spindle_rulebase_destroy(spindle.rules);
+		return -1;
+	}
 	generate->rules = spindle.rules;
 	if(spindle_cache_init(generate))
 	{
@@ -108,6 +112,11 @@ spindle_generate_init_(SPINDLEGENERATE *generate)
 	}
 	generate->describedby = twine_config_get_bool(PLUGIN_NAME ":describedby", twine_config_get_bool("spindle:describedby", 1));
 	generate->describeinbound = twine_config_get_bool(PLUGIN_NAME ":describe-inbound", twine_config_get_bool("spindle:describe-inbound", 0));
+	generate->sourcebatch = twine_config_get_int(PLUGIN_NAME ":source-batch", twine_config_get_int("spindle:source-batch", 32));
+	if(generate->sourcebatch < 1)
+	{
+		generate->sourcebatch = 1;
+	}
 	return 0;
 }
 
@@ -36,6 +36,24 @@ struct mq_connection_struct
 	MQCONNIMPL *impl;
 	MQ_CONNECTION_COMMON_MEMBERS;
 	SQL *sql;
+	/* The maximum number of entries leased at a time */
+	int batch;
+	/* The duration of a lease, in seconds */
+	int lease;
+	/* Current, minimum and maximum delays when the queue is idle, in ms */
+	int idle;
+	int idlemin;
+	int idlemax;
+	/* Leased entries which haven't yet been handed out, and their epochs */
+	char **queue;
+	long *epochs;
+	size_t qcount;
+	size_t qpos;
+	/* The expiry time of the lease on the queued entries, as recorded in the
+	 * database, and when it was last taken out or renewed
+	 */
+	char leased[40];
+	time_t leasedat;
 };
 
 struct mq_message_struct
@@ -43,6 +61,8 @@ struct mq_message_struct
 	MQMESSAGEIMPL *impl;
 	MQ_MESSAGE_COMMON_MEMBERS;
 	char *buf;
+	/* The state epoch of the entry when it was leased */
+	long epoch;
 };
 
 static int spindle_mq_register_(const char *scheme, void *handle);
@@ -62,6 +82,10 @@ static int spindle_mq_deliver_(MQ *self);
 static int spindle_mq_create_(MQ *self, MQMESSAGE **msg);
 static int spindle_mq_set_cluster_(MQ *self, CLUSTER *cluster);
 static CLUSTER *spindle_mq_cluster_(MQ *self);
+static int spindle_mq_lease_(MQ *self, int nodecount, int nodeid);
+static int spindle_mq_unlease_(MQ *self);
+static int spindle_mq_renew_(MQ *self);
+static int spindle_mq_wait_(MQ *self);
 
 /* MQMESSAGE implementation */
 static unsigned long spindle_mqmessage_release_(MQMESSAGE *self);
@@ -172,9 +196,12 @@ spindle_mq_release_(MQ *self)
 {
 	if(self->sql)
 	{
+		spindle_mq_unlease_(self);
 		sql_disconnect(self->sql);
 		self->sql = NULL;
 	}
+	free(self->queue);
+	free(self->epochs);
 	free(self->errmsg);
 	free(self->uri);
 	free(self);
@@ -257,6 +284,42 @@ spindle_mq_connect_recv_(MQ *self)
 		twine_logf(LOG_ERR, PLUGIN_NAME ": MQ: failed to connect to SQL database\n", self->uri + 8);
 		return -1;
 	}
+	self->batch = twine_config_get_int("spindle:mq-batch", 16);
+	if(self->batch < 1)
+	{
+		self->batch = 1;
+	}
+	self->lease = twine_config_get_int("spindle:mq-lease", 600);
+	if(self->lease < 1)
+	{
+		self->lease = 600;
+	}
+	self->idlemin = twine_config_get_int("spindle:mq-idle-min", 25);
+	if(self->idlemin < 1)
+	{
+		self->idlemin = 1;
+	}
+	self->idlemax = twine_config_get_int("spindle:mq-idle-max", 1000);
+	if(self->idlemax < self->idlemin)
+	{
+		self->idlemax = self->idlemin;
+	}
+	self->idle = self->idlemin;
+	self->queue = (char **) calloc(self->batch, sizeof(char *));
+	self->epochs = (long *) calloc(self->batch, sizeof(long));
+	if(!self->queue || !self->epochs)
+	{
+		SET_ERRNO(self);
+		free(self->queue);
+		self->queue = NULL;
+		free(self->epochs);
+		self->epochs = NULL;
+		sql_disconnect(self->sql);
+		self->sql = NULL;
+		return -1;
+	}
+	self->qcount = 0;
+	self->qpos = 0;
 	return 0;
 }
 
@@ -273,16 +336,20 @@ static int spindle_mq_disconnect_(MQ *self)
 	self->state = MQS_DISCONNECTED;
 	if(self->sql)
 	{
+		spindle_mq_unlease_(self);
 		sql_disconnect(self->sql);
 		self->sql = NULL;
 	}
+	free(self->queue);
+	self->queue = NULL;
+	free(self->epochs);
+	self->epochs = NULL;
 	return 0;
 }
 
 static int
 spindle_mq_next_(MQ *self, MQMESSAGE **msg)
 {
-	SQL_STATEMENT *rs;
 	int nodeid, nodecount, logged;
 	MQMESSAGE *p;
 	
@@ -306,13 +373,14 @@ spindle_mq_next_(MQ *self, MQMESSAGE **msg)
 					twine_logf(LOG_NOTICE, PLUGIN_NAME ": MQ: waiting until we join the cluster\n");
 					logged = 1;
 				}
-				sleep(2);
+				spindle_mq_wait_(self);
 			}
 		}
 		while(!nodecount);
 		if(logged)
 		{
 			twine_logf(LOG_NOTICE, PLUGIN_NAME ": MQ: cluster connection established\n");
+			self->idle = self->idlemin;
 		}
 	}
 	else
@@ -320,49 +388,236 @@ spindle_mq_next_(MQ *self, MQMESSAGE **msg)
 		nodeid = 0;
 		nodecount = 1;
 	}
-	while(1)
-	{
-		rs = sql_queryf(self->sql,
-						"SELECT \"id\" "
-						" FROM "
-						" \"state\" "
-						" WHERE "
-						"\"state\".\"status\" = %Q AND "
-						" \"state\".\"tinyhash\" %% %d = %d "
-						" LIMIT 1",
-						"DIRTY", nodecount, nodeid);
-		if(!rs)
+	if(self->qpos >= self->qcount)
+	{
+		if(spindle_mq_lease_(self, nodecount, nodeid) < 0)
 		{
-			twine_logf(LOG_CRIT,  PLUGIN_NAME ": MQ: %s\n", sql_error(self->sql));
 			return -1;
 		}
-		if(sql_stmt_eof(rs))
+		if(!self->qcount)
 		{
-			sql_stmt_destroy(rs);
-			sleep(1);
+			spindle_mq_wait_(self);
 			return 0;
 		}
-		p = spindle_mqmessage_construct_(self);
-		if(!p)
+		self->idle = self->idlemin;
+	}
+	else
+	{
+		if(spindle_mq_renew_(self) < 0)
 		{
-			SET_ERRNO(self);
-			twine_logf(LOG_CRIT, PLUGIN_NAME ": MQ: failed to create new message\n");
 			return -1;
 		}
-		twine_logf(LOG_DEBUG, PLUGIN_NAME ": MQ: next item is {%s}\n", sql_stmt_str(rs, 0));
-		p->kind = MQK_INCOMING;
-		p->buf = strdup(sql_stmt_str(rs, 0));
-		if(!p->buf)
+		if(self->qpos >= self->qcount)
+		{
+			/* Every remaining lease was lost; try again */
+			return 0;
+		}
+	}
+	p = spindle_mqmessage_construct_(self);
+	if(!p)
+	{
+		SET_ERRNO(self);
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": MQ: failed to create new message\n");
+		return -1;
+	}
+	/* Ownership of the buffer passes to the message */
+	p->kind = MQK_INCOMING;
+	p->buf = self->queue[self->qpos];
+	p->epoch = self->epochs[self->qpos];
+	self->queue[self->qpos] = NULL;
+	self->qpos++;
+	twine_logf(LOG_DEBUG, PLUGIN_NAME ": MQ: next item is {%s}\n", p->buf);
+	*msg = p;
+	return 0;
+}
+
+/* Lease a batch of dirty entries, most urgent and then longest-waiting
+ * first, marking them as in-progress so that no other worker will pick them
+ * up until the lease expires. Entries whose queue time is in the future are
+ * still within their debounce interval, and are skipped.
+ */
+static int
+spindle_mq_lease_(MQ *self, int nodecount, int nodeid)
+{
+	SQL_STATEMENT *rs;
+	const char *t;
+
+	self->qcount = 0;
+	self->qpos = 0;
+	rs = sql_queryf(self->sql,
+					"UPDATE \"state\" SET "
+					" \"status\" = %Q, "
+					" \"leased\" = (now() AT TIME ZONE 'UTC') + interval '%d seconds' "
+					" WHERE \"id\" IN ("
+					"  SELECT \"id\" FROM \"state\" "
+					"  WHERE "
+					"  ((\"status\" = %Q AND (\"queued\" IS NULL OR \"queued\" <= (now() AT TIME ZONE 'UTC'))) OR "
+					"   (\"status\" = %Q AND \"leased\" < (now() AT TIME ZONE 'UTC'))) AND "
+					"  \"tinyhash\" %% %d = %d "
+					"  ORDER BY \"priority\", \"queued\" "
+					"  LIMIT %d "
+					"  FOR UPDATE SKIP LOCKED"
+					" ) "
+					" RETURNING \"id\", \"epoch\", \"leased\"",
+					"IN-PROGRESS", self->lease, "DIRTY", "IN-PROGRESS", nodecount, nodeid, self->batch);
+	if(!rs)
+	{
+		twine_logf(LOG_CRIT,  PLUGIN_NAME ": MQ: %s\n", sql_error(self->sql));
+		return -1;
+	}
+	for(; !sql_stmt_eof(rs) && self->qcount < (size_t) self->batch; sql_stmt_next(rs))
+	{
+		if(!(t = sql_stmt_str(rs, 0)))
+		{
+			continue;
+		}
+		self->queue[self->qcount] = strdup(t);
+		if(!self->queue[self->qcount])
 		{
 			SET_ERRNO(self);
 			twine_logf(LOG_CRIT, PLUGIN_NAME ": MQ: failed to duplicate buffer for incoming message\n");
-			free(p);
+			sql_stmt_destroy(rs);
 			return -1;
 		}
-		sql_stmt_destroy(rs);
-		*msg = p;
-		break;
+		self->epochs[self->qcount] = sql_stmt_long(rs, 1);
+		if(!self->qcount && (t = sql_stmt_str(rs, 2)))
+		{
+			/* Every entry leased by the statement has the same expiry */
+			strncpy(self->leased, t, sizeof(self->leased) - 1);
+			self->leased[sizeof(self->leased) - 1] = 0;
+		}
+		self->qcount++;
+	}
+	sql_stmt_destroy(rs);
+	self->leasedat = time(NULL);
+	if(self->qcount)
+	{
+		twine_logf(LOG_DEBUG, PLUGIN_NAME ": MQ: leased %d items\n", (int) self->qcount);
+	}
+	return 0;
+}
+
+/* Once half of the lease on a batch has elapsed, renew it for the entries
+ * which haven't been handed out yet, so that those at the end of a batch
+ * can't expire and be leased by another worker while this one is still busy
+ * with earlier entries. An entry whose lease no longer matches ours has been
+ * picked up elsewhere in the meantime, and is dropped from the queue.
+ */
+static int
+spindle_mq_renew_(MQ *self)
+{
+	SQL_STATEMENT *rs;
+	char *ids, *p, *kept;
+	const char *t;
+	size_t c, n;
+
+	if(self->qpos >= self->qcount || time(NULL) - self->leasedat < self->lease / 2)
+	{
+		return 0;
+	}
+	ids = (char *) malloc((self->qcount - self->qpos) * 40 + 3);
+	kept = (char *) calloc(self->qcount, 1);
+	if(!ids || !kept)
+	{
+		SET_ERRNO(self);
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": MQ: failed to allocate memory to renew leases\n");
+		free(ids);
+		free(kept);
+		return -1;
+	}
+	p = ids;
+	*p = '{';
+	p++;
+	for(c = self->qpos; c < self->qcount; c++)
+	{
+		p += sprintf(p, "%s%s", (c > self->qpos ? "," : ""), self->queue[c]);
+	}
+	strcpy(p, "}");
+	rs = sql_queryf(self->sql, "UPDATE \"state\" SET "
+					"\"leased\" = (now() AT TIME ZONE 'UTC') + interval '%d seconds' "
+					"WHERE \"id\" = ANY(%Q::uuid[]) AND \"status\" = %Q AND \"leased\" = %Q::timestamp "
+					"RETURNING \"id\", \"leased\"",
+					self->lease, ids, "IN-PROGRESS", self->leased);
+	free(ids);
+	if(!rs)
+	{
+		twine_logf(LOG_CRIT,  PLUGIN_NAME ": MQ: %s\n", sql_error(self->sql));
+		free(kept);
+		return -1;
+	}
+	for(; !sql_stmt_eof(rs); sql_stmt_next(rs))
+	{
+		if(!(t = sql_stmt_str(rs, 0)))
+		{
+			continue;
+		}
+		for(c = self->qpos; c < self->qcount; c++)
+		{
+			if(!strcmp(self->queue[c], t))
+			{
+				kept[c] = 1;
+				break;
+			}
+		}
+		if((t = sql_stmt_str(rs, 1)))
+		{
+			strncpy(self->leased, t, sizeof(self->leased) - 1);
+			self->leased[sizeof(self->leased) - 1] = 0;
+		}
+	}
+	sql_stmt_destroy(rs);
+	self->leasedat = time(NULL);
+	/* Drop any entries whose leases were lost */
+	for(c = n = self->qpos; c < self->qcount; c++)
+	{
+		if(!kept[c])
+		{
+			twine_logf(LOG_NOTICE, PLUGIN_NAME ": MQ: lease on {%s} expired before it could be processed\n", self->queue[c]);
+			free(self->queue[c]);
+			self->queue[c] = NULL;
+			continue;
+		}
+		self->queue[n] = self->queue[c];
+		self->epochs[n] = self->epochs[c];
+		if(n != c)
+		{
+			self->queue[c] = NULL;
+		}
+		n++;
 	}
+	self->qcount = n;
+	free(kept);
+	return 0;
+}
+
+/* Wait before polling an idle queue again, backing off exponentially up
+ * to the configured maximum; the delay is reset as soon as work is found.
+ */
+static int
+spindle_mq_wait_(MQ *self)
+{
+	usleep((useconds_t) self->idle * 1000);
+	self->idle *= 2;
+	if(self->idle > self->idlemax)
+	{
+		self->idle = self->idlemax;
+	}
+	return 0;
+}
+
+/* Return any leased entries which haven't been handed out to the queue */
+static int
+spindle_mq_unlease_(MQ *self)
+{
+	for(; self->qpos < self->qcount; self->qpos++)
+	{
+		sql_executef(self->sql, "UPDATE \"state\" SET \"status\" = %Q, \"leased\" = NULL WHERE \"id\" = %Q AND \"status\" = %Q",
+			"DIRTY", self->queue[self->qpos], "IN-PROGRESS");
+		free(self->queue[self->qpos]);
+		self->queue[self->qpos] = NULL;
+	}
+	self->qcount = 0;
+	self->qpos = 0;
 	return 0;
 }
 
@@ -421,6 +676,7 @@ static unsigned long
 spindle_mqmessage_release_(MQMESSAGE *self)
 {
 	RESET_ERROR(self->connection);
+	free(self->buf);
 	free(self);
 	return 0;
 }
@@ -442,8 +698,16 @@ spindle_mqmessage_accept_(MQMESSAGE *self)
 		SET_SYSERR(self->connection, EINVAL);
 		return -1;
 	}
-	if(sql_executef(self->connection->sql, "UPDATE \"state\" SET \"status\" = %Q, \"flags\" = %d WHERE \"id\" = %Q",
-		"COMPLETE", 0, self->buf))
+	/* Generation normally records the outcome itself; if the entry is
+	 * still in progress, complete it here, unless it has been marked dirty
+	 * again since it was leased, in which case it is returned to the queue
+	 */
+	if(sql_executef(self->connection->sql, "UPDATE \"state\" SET "
+		"\"status\" = CASE WHEN \"epoch\" = %ld THEN %Q ELSE %Q END, "
+		"\"flags\" = CASE WHEN \"epoch\" = %ld THEN 0 ELSE \"flags\" END, "
+		"\"leased\" = NULL "
+		"WHERE \"id\" = %Q AND \"status\" = %Q",
+		self->epoch, "COMPLETE", "DIRTY", self->epoch, self->buf, "IN-PROGRESS"))
 	{
 		return -1;
 	}
@@ -459,8 +723,8 @@ spindle_mqmessage_reject_(MQMESSAGE *self)
 		SET_SYSERR(self->connection, EINVAL);
 		return -1;
 	}
-	if(sql_executef(self->connection->sql, "UPDATE \"state\" SET \"status\" = %Q WHERE \"id\" = %Q",
-		"REJECTED", self->buf))
+	if(sql_executef(self->connection->sql, "UPDATE \"state\" SET \"status\" = %Q, \"leased\" = NULL WHERE \"id\" = %Q AND \"status\" IN (%Q, %Q)",
+		"REJECTED", self->buf, "IN-PROGRESS", "COMPLETE"))
 	{
 		return -1;
 	}
@@ -476,6 +740,13 @@ spindle_mqmessage_pass_(MQMESSAGE *self)
 		SET_SYSERR(self->connection, EINVAL);
 		return -1;
 	}
+	/* Give up the lease so that another worker can pick it up */
+	if(self->buf &&
+	   sql_executef(self->connection->sql, "UPDATE \"state\" SET \"status\" = %Q, \"leased\" = NULL WHERE \"id\" = %Q AND \"status\" = %Q",
+		"DIRTY", self->buf, "IN-PROGRESS"))
+	{
+		return -1;
+	}
 	return 0;
 }
 
@@ -26,10 +26,14 @@
 # include <ctype.h>
 # include <time.h>
 # include <unistd.h>
+# include <fcntl.h>
 # include <sys/types.h>
 # include <sys/time.h>
 # include <sys/param.h>
 # include <sys/stat.h>
+# include <sys/mman.h>
+# include <sys/wait.h>
+# include <poll.h>
 # include <errno.h>
 # include <libawsclient.h>
 # include <libmq-engine.h>
@@ -41,6 +45,9 @@
 
 # define SPINDLE_URI_MIME               "application/x-spindle-uri"
 
+/* The maximum number of levels of cache sub-directories */
+# define SPINDLE_CACHE_SHARD_MAX        4
+
 # define SPINDLE_DB_INDEX_VERSION       2
 
 typedef struct spindle_generate_struct SPINDLEGENERATE;
@@ -58,6 +65,14 @@ struct spindle_generate_struct
 	int s3_verbose;
 	/* The filesystem paths that precomposed N-Quads should be stored in */
 	char *cachepath;
+	/* The number of levels of sub-directories that cache files are spread
+	 * across, whether each file is flushed to disk before it replaces
+	 * the previous version, and whether files are mapped into memory to be
+	 * read (which is only safe if no writer rewrites them in place)
+	 */
+	int cacheshard;
+	int cachesync;
+	int cachemmap;
 	/* Names of specific predicates */
 	char *titlepred;
 	struct spindle_predicatemap_struct *licensepred;
@@ -72,6 +87,10 @@ struct spindle_generate_struct
 	 * one of our corefs to be 'source data'?
 	 */
 	int describeinbound;
+	/* The maximum number of co-references whose source data is fetched
+	 * by a single query
+	 */
+	int sourcebatch;
 };
 
 /* State used while generating a single proxy entry */
@@ -92,8 +111,18 @@ struct spindle_entry_struct
 	const char *classname;
 	char **refs;
 	size_t refcount;
+	/* Hash-indexed copy of refs, for membership tests */
+	struct spindle_strset_struct *refset;
 	time_t modified;
 	int flags;
+	/* The priority this entity is being generated with; entities which
+	 * it triggers are queued no more urgently than this
+	 */
+	int priority;
+	/* The state epoch when generation began; if it has moved on by the
+	 * time we finish, the entity is queued to be generated again
+	 */
+	long epoch;
 	
 	/* Data which will be inserted into the root graph, always in the form
 	 * <proxy> pred obj
@@ -155,10 +184,12 @@ struct spindle_license_struct
 };
 
 /* Generate and index data about an entity */
-int spindle_generate(SPINDLEGENERATE *generate, const char *identifier, int mode);
+int spindle_generate(SPINDLEGENERATE *generate, const char *identifier, int mode, int priority);
 int spindle_generate_graph(twine_graph *graph, void *data);
 int spindle_generate_message(const char *mime, const unsigned char *buf, size_t buflen, void *data);
 int spindle_generate_update(const char *name, const char *identifier, void *data);
+/* Re-generate all known proxies */
+int spindle_generate_all(SPINDLEGENERATE *generate);
 
 /* Initialise and release an entry's data structure */
 int spindle_entry_init(SPINDLEENTRY *data, SPINDLEGENERATE *generate, const char *localname);
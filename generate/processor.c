@@ -23,8 +23,6 @@
 
 #include "p_spindle-generate.h"
 
-static int spindle_generate_all_(SPINDLEGENERATE *generate);
-
 /* TODO: don't use SF_xxx flags here - use TK_xxx flags instead, as they're
  * used in the state and triggers tables
  */
@@ -49,12 +47,12 @@ spindle_generate_update(const char *name, const char *identifier, void *data)
 	{
 		if(generate->spindle->db)
 		{			
-			return spindle_generate_all_(generate);
+			return spindle_generate_all(generate);
 		}
 		twine_logf(LOG_CRIT, PLUGIN_NAME ": can only update all items when using the a relational database index\n");
 		return -1;
 	}
-	return spindle_generate(generate, identifier, SF_NONE);
+	return spindle_generate(generate, identifier, SF_NONE, SPINDLE_PRIO_URGENT);
 }
 
 /* Graph processing hook, invoked by Twine operations
@@ -71,18 +69,26 @@ spindle_generate_graph(twine_graph *graph, void *data)
 	SPINDLEGENERATE *generate;
 
 	generate = (SPINDLEGENERATE *) data;
-	return spindle_generate(data, graph->uri, SF_NONE);
+	return spindle_generate(data, graph->uri, SF_NONE, SPINDLE_PRIO_NORMAL);
 }
 
 /* Process a message containing Spindle proxy URIs by passing them to the
  * update handler.
+ *
+ * The message takes the form:
+ *
+ *   <uri> [moved|updated|refreshed] [priority=N]
+ *
+ * Where a priority hint is given, entities triggered by this update are
+ * queued no more urgently than N; otherwise, the priority recorded in the
+ * state table is used.
  */
 int
 spindle_generate_message(const char *mime, const unsigned char *buf, size_t buflen, void *data)
 {
 	SPINDLEGENERATE *generate;
-	char *str, *t;
-	int r, mode;
+	char *str, *t, *p;
+	int r, mode, priority;
 
 	(void) mime;
 
@@ -105,12 +111,31 @@ spindle_generate_message(const char *mime, const unsigned char *buf, size_t bufl
 	{
 		*t = 0;
 	}
+	priority = SPINDLE_PRIO_NONE;
 	t = strchr(str, ' ');
 	if(t)
 	{
 		*t = 0;
 		t++;
-		if(!strcmp(t, "moved"))
+	}
+	for(; t && *t; t = p)
+	{
+		p = strchr(t, ' ');
+		if(p)
+		{
+			*p = 0;
+			p++;
+		}
+		if(!strncmp(t, "priority=", 9))
+		{
+			priority = atoi(t + 9);
+			if(priority < 1)
+			{
+				twine_logf(LOG_WARNING, PLUGIN_NAME ": priority hint '%s' for <%s> is not valid\n", t + 9, str);
+				priority = SPINDLE_PRIO_NONE;
+			}
+		}
+		else if(!strcmp(t, "moved"))
 		{
 			mode = SF_MOVED;
 		}
@@ -127,42 +152,7 @@ spindle_generate_message(const char *mime, const unsigned char *buf, size_t bufl
 			twine_logf(LOG_WARNING, PLUGIN_NAME ": update-mode flag '%s' for <%s> is not recognised\n", t, str);
 		}
 	}
-	r = spindle_generate(generate, str, mode);
+	r = spindle_generate(generate, str, mode, priority);
 	free(str);
 	return r;
 }
-
-/* Generate data for all known entities */
-static int
-spindle_generate_all_(SPINDLEGENERATE *generate)
-{
-	SQL_STATEMENT *rs;
-	int r;
-	const char *t;
-
-	rs = sql_query(generate->db, "SELECT \"id\" FROM \"proxy\"");
-	if(!rs)
-	{
-		twine_logf(LOG_ERR, PLUGIN_NAME ": failed to query for item UUIDs\n");
-		return -1;
-	}
-	r = 0;
-	for(; !sql_stmt_eof(rs); sql_stmt_next(rs))
-	{
-		t = sql_stmt_str(rs, 0);
-		twine_logf(LOG_DEBUG, PLUGIN_NAME ": will update {%s}\n", t);
-		if(!t)
-		{
-			twine_logf(LOG_ERR, PLUGIN_NAME ": failed to obtain UUID from database column\n");
-			r = -1;
-			break;
-		}
-		r = spindle_generate(generate, t, SF_NONE);
-		if(r)
-		{
-			break;
-		}
-	}
-	sql_stmt_destroy(rs);
-	return r;
-}
@@ -71,11 +71,21 @@ struct propdata_struct
 	struct propmatch_struct *descmatch;
 	int has_geo;
 	double lat, lon;
+	/* The candidate objects of proxy-only properties, and their proxies
+	 * (or NULL), resolved in bulk before matching
+	 */
+	struct spindle_strset_struct *proxyuris;
+	char **proxies;
 };
 
+/* A function invoked by spindle_prop_loop_() for each relevant statement */
+typedef int (*spindle_prop_handler_fn)(struct propdata_struct *data, librdf_statement *st, const char *predicate, int inverse);
+
 static int spindle_prop_init_(struct propdata_struct *data, SPINDLEENTRY *cache);
 static int spindle_prop_cleanup_(struct propdata_struct *data);
-static int spindle_prop_loop_(struct propdata_struct *data);
+static int spindle_prop_loop_(struct propdata_struct *data, spindle_prop_handler_fn handler);
+static int spindle_prop_collect_(struct propdata_struct *data, librdf_statement *st, const char *predicate, int inverse);
+static int spindle_prop_resolve_(struct propdata_struct *data);
 static int spindle_prop_test_(struct propdata_struct *data, librdf_statement *st, const char *predicate, int inverse);
 static int spindle_prop_candidate_(struct propdata_struct *data, struct propmatch_struct *match, struct spindle_predicatematch_struct *criteria, librdf_statement *st, librdf_node *obj);
 static int spindle_prop_candidate_uri_(struct propdata_struct *data, struct propmatch_struct *match, struct spindle_predicatematch_struct *criteria, librdf_statement *st, librdf_node *obj);
@@ -99,7 +109,18 @@ spindle_prop_update_entry(SPINDLEENTRY *cache)
 		return -1;
 	}
 
-	r = spindle_prop_loop_(&data);
+	/* Gather the objects of proxy-only properties and look up their
+	 * proxies in one go, then perform the matching itself
+	 */
+	r = spindle_prop_loop_(&data, spindle_prop_collect_);
+	if(!r)
+	{
+		r = spindle_prop_resolve_(&data);
+	}
+	if(!r)
+	{
+		r = spindle_prop_loop_(&data, spindle_prop_test_);
+	}
 	if(!r)
 	{
 		r = spindle_prop_apply_(&data);
@@ -186,6 +207,11 @@ spindle_prop_init_(struct propdata_struct *data, SPINDLEENTRY *cache)
 	{
 		data->matches[c].map = &(data->maps[c]);
 	}
+	data->proxyuris = spindle_strset_create();
+	if(!data->proxyuris)
+	{
+		return -1;
+	}
 	return 0;
 }
 
@@ -214,12 +240,24 @@ spindle_prop_cleanup_(struct propdata_struct *data)
 		}
 		free(data->matches);
 	}
+	if(data->proxies)
+	{
+		for(c = 0; c < data->proxyuris->count; c++)
+		{
+			free(data->proxies[c]);
+		}
+		free(data->proxies);
+	}
+	if(data->proxyuris)
+	{
+		spindle_strset_destroy(data->proxyuris);
+	}
 	return 0;
 }
 
-/* Loop over a model and process any known predicates */
+/* Loop over a model and pass any statements about the entity to a handler */
 static int
-spindle_prop_loop_(struct propdata_struct *data)
+spindle_prop_loop_(struct propdata_struct *data, spindle_prop_handler_fn handler)
 {
 	librdf_statement *query, *st;
 	librdf_stream *stream;
@@ -227,7 +265,6 @@ spindle_prop_loop_(struct propdata_struct *data)
 	librdf_uri *puri, *suri, *ouri;
 	const char *pstr, *sstr, *ostr;
 	int r;
-	size_t c;
 
 	r = 0;
 	query = librdf_new_statement(data->spindle->world);
@@ -265,19 +302,18 @@ spindle_prop_loop_(struct propdata_struct *data)
 			ostr = (const char *) librdf_uri_as_string(ouri);
 		}
 		r = 0;
-		for(c = 0; data->entry->refs[c]; c++)
+		if(!data->entry->refset)
 		{
-			if(sstr && !strcmp(sstr, data->entry->refs[c]))
-			{
-				r = spindle_prop_test_(data, st, pstr, 0);
-				break;
-			}
-			if(ostr && !strcmp(ostr, data->entry->refs[c]))
-			{
-/*				twine_logf(LOG_DEBUG, PLUGIN_NAME ": spindle_prop_loop_(): object match\n"); */
-				r = spindle_prop_test_(data, st, pstr, 1);
-				break;
-			}
+			continue;
+		}
+		if(sstr && spindle_strset_contains(data->entry->refset, sstr))
+		{
+			r = handler(data, st, pstr, 0);
+		}
+		else if(ostr && spindle_strset_contains(data->entry->refset, ostr))
+		{
+/*			twine_logf(LOG_DEBUG, PLUGIN_NAME ": spindle_prop_loop_(): object match\n"); */
+			r = handler(data, st, pstr, 1);
 		}
 		if(r < 0)
 		{
@@ -289,6 +325,64 @@ spindle_prop_loop_(struct propdata_struct *data)
 	return (r < 0 ? -1 : 0);
 }
 
+/* Record the object of a statement if it's a candidate for a proxy-only
+ * property, so that its proxy can be looked up along with the others
+ */
+static int
+spindle_prop_collect_(struct propdata_struct *data, librdf_statement *st, const char *predicate, int inverse)
+{
+	const struct spindle_predicateindex_struct *entries;
+	struct spindle_predicatematch_struct *criteria;
+	size_t c, count;
+	librdf_node *obj;
+	librdf_uri *uri;
+
+	entries = spindle_rulebase_pred_lookup(data->entry->rules, predicate, &count);
+	for(c = 0; c < count; c++)
+	{
+		if(!data->maps[entries[c].map].proxyonly ||
+		   data->maps[entries[c].map].expected != RAPTOR_TERM_TYPE_URI)
+		{
+			continue;
+		}
+		criteria = &(data->maps[entries[c].map].matches[entries[c].match]);
+		if(criteria->inverse != inverse)
+		{
+			continue;
+		}
+		if(criteria->onlyfor &&
+		   (!data->classname || strcmp(criteria->onlyfor, data->classname)))
+		{
+			continue;
+		}
+		obj = (inverse ? librdf_statement_get_subject(st) : librdf_statement_get_object(st));
+		if(!librdf_node_is_resource(obj) || !(uri = librdf_node_get_uri(obj)))
+		{
+			return 0;
+		}
+		return spindle_strset_add(data->proxyuris, (const char *) librdf_uri_as_string(uri));
+	}
+	return 0;
+}
+
+/* Look up the proxies for all of the collected candidate objects */
+static int
+spindle_prop_resolve_(struct propdata_struct *data)
+{
+	if(!data->proxyuris->count)
+	{
+		return 0;
+	}
+	data->proxies = (char **) calloc(data->proxyuris->count, sizeof(char *));
+	if(!data->proxies)
+	{
+		twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate memory for proxy lookups\n");
+		return -1;
+	}
+	twine_logf(LOG_DEBUG, PLUGIN_NAME ": resolving proxies for %lu candidate objects\n", (unsigned long) data->proxyuris->count);
+	return spindle_proxy_locate_many(data->spindle, (const char **) data->proxyuris->strings, data->proxyuris->count, data->proxies);
+}
+
 /* Apply scored matches to the proxy model ready for insertion */
 static int
 spindle_prop_apply_(struct propdata_struct *data)
@@ -423,40 +517,40 @@ spindle_prop_apply_(struct propdata_struct *data)
 static int
 spindle_prop_test_(struct propdata_struct *data, librdf_statement *st, const char *predicate, int inverse)
 {
-	size_t c, d;
+	const struct spindle_predicateindex_struct *entries;
+	struct spindle_predicatematch_struct *criteria;
+	size_t c, count, map;
 	librdf_node *obj;
 
-	for(c = 0; data->maps[c].target; c++)
+	entries = spindle_rulebase_pred_lookup(data->entry->rules, predicate, &count);
+	map = (size_t) -1;
+	for(c = 0; c < count; c++)
 	{
-		if(!data->maps[c].matches)
+		if(entries[c].map == map)
 		{
+			/* Only the first matching entry for each map is used */
 			continue;
 		}
-		for(d = 0; data->maps[c].matches[d].predicate; d++)
+		criteria = &(data->maps[entries[c].map].matches[entries[c].match]);
+		if(criteria->inverse != inverse)
 		{
-			if(data->maps[c].matches[d].inverse != inverse)
-			{
-				continue;
-			}
-			if(data->maps[c].matches[d].onlyfor &&
-			   (!data->classname || strcmp(data->maps[c].matches[d].onlyfor, data->classname)))
-			{
-				continue;
-			}
-			if(!strcmp(predicate, data->maps[c].matches[d].predicate))
-			{
-				if(inverse)
-				{
-					obj = librdf_statement_get_subject(st);
-				}
-				else
-				{
-					obj = librdf_statement_get_object(st);
-				}
-				spindle_prop_candidate_(data, &(data->matches[c]), &(data->maps[c].matches[d]), st, obj);
-				break;
-			}
+			continue;
+		}
+		if(criteria->onlyfor &&
+		   (!data->classname || strcmp(criteria->onlyfor, data->classname)))
+		{
+			continue;
 		}
+		if(inverse)
+		{
+			obj = librdf_statement_get_subject(st);
+		}
+		else
+		{
+			obj = librdf_statement_get_object(st);
+		}
+		map = entries[c].map;
+		spindle_prop_candidate_(data, &(data->matches[map]), criteria, st, obj);
 	}
 	return 0;
 }
@@ -496,7 +590,9 @@ spindle_prop_candidate_uri_(struct propdata_struct *data, struct propmatch_struc
 {
 	librdf_node *node, *newobj;
 	librdf_statement *newst;
+	const char *objstr;
 	char *uri;
+	size_t index;
 
 	(void) st;
 
@@ -512,7 +608,15 @@ spindle_prop_candidate_uri_(struct propdata_struct *data, struct propmatch_struc
 	newobj = NULL;
 	if(match->map->proxyonly)
 	{
-		uri = spindle_proxy_locate(data->spindle, (const char *) librdf_uri_as_string(librdf_node_get_uri(obj)));
+		objstr = (const char *) librdf_uri_as_string(librdf_node_get_uri(obj));
+		if(data->proxies && spindle_strset_index(data->proxyuris, objstr, &index))
+		{
+			uri = (data->proxies[index] ? strdup(data->proxies[index]) : NULL);
+		}
+		else
+		{
+			uri = spindle_proxy_locate(data->spindle, objstr);
+		}
 		if(!uri || !strcmp(uri, data->localname))
 		{
 			free(uri);
@@ -56,6 +56,7 @@ spindle_related_fetch_entry(SPINDLEENTRY *data)
 		/* Cache information about external resources related to this
 		 * entity, restricted by the predicate used for the relation
 		 */
+		spindle_stats_sparql(data->spindle, 0);
 		if(sparql_queryf_model(data->spindle->sparql, data->extradata,
 							   "SELECT DISTINCT ?s ?p ?o ?g\n"
 							   " WHERE {\n"
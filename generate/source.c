@@ -113,10 +113,23 @@ spindle_source_refs_(SPINDLEENTRY *data)
 			return -1;
 		}
 	}
+	if(data->refset)
+	{
+		spindle_strset_destroy(data->refset);
+	}
+	data->refset = spindle_strset_create();
+	if(!data->refset)
+	{
+		return -1;
+	}
 	data->refcount = 0;
 	for(c = 0; data->refs[c]; c++)
 	{
 		data->refcount++;
+		if(spindle_strset_add(data->refset, data->refs[c]))
+		{
+			return -1;
+		}
 		/* Add <ref> owl:sameAs <localname> triples to the proxy model */
 		st = twine_rdf_st_create();
 		librdf_statement_set_subject(st, twine_rdf_node_createuri(data->refs[c]));
@@ -173,51 +186,62 @@ spindle_source_graphs_(SPINDLEENTRY *data)
 
 /* Fetch all of the source data about the entities that relate to a particular
  * proxy using the database
+ *
+ * The co-references are bound to ?ref with a VALUES block, so that a single
+ * query fetches the data for up to generate->sourcebatch of them at a time.
  */
 static int
 spindle_source_fetch_db_(SPINDLEENTRY *data)
 {
+	size_t base, end, c, len;
+	char *qbuf, *p;
 	int r;
-	size_t c;
 
 	r = 0;
-	for(c = 0; data->refs[c]; c++)
+	for(base = 0; !r && base < data->refcount; base = end)
 	{
-		if(data->generate->describeinbound)
-		{	   
-			r = sparql_queryf_model(data->sparql, data->sourcedata,
-									"SELECT DISTINCT ?s ?p ?o ?g\n"
-									" WHERE {\n"
-									"  GRAPH ?g {\n"
-									"  { <%s> ?p ?o .\n"
-									"   BIND(<%s> as ?s)\n"
-									"  }\n"
-									"  UNION\n"
-									"  { ?s ?p <%s> .\n"
-									"   FILTER(?p != <" NS_RDF "type>)\n"
-									"   BIND(<%s> as ?o)\n"
-									"  }\n"
-									" }\n"
-									"}",
-									data->refs[c], data->refs[c], data->refs[c], data->refs[c]);
+		end = base + data->generate->sourcebatch;
+		if(end > data->refcount)
+		{
+			end = data->refcount;
 		}
-		else
+		len = 512;
+		for(c = base; c < end; c++)
 		{
-			r = sparql_queryf_model(data->sparql, data->sourcedata,
-									"SELECT DISTINCT ?s ?p ?o ?g\n"
-									" WHERE {\n"
-									"  GRAPH ?g {\n"
-									"  { <%s> ?p ?o .\n"
-									"   BIND(<%s> as ?s)\n"
-									"  }\n"
-									" }\n"
-									"}",
-									data->refs[c], data->refs[c]);
+			len += strlen(data->refs[c]) + 3;
 		}
-		if(r)
+		qbuf = (char *) malloc(len);
+		if(!qbuf)
+		{
+			twine_logf(LOG_CRIT, PLUGIN_NAME ": failed to allocate %lu bytes for source data query\n", (unsigned long) len);
+			return -1;
+		}
+		p = qbuf;
+		p += sprintf(p, "SELECT DISTINCT ?s ?p ?o ?g\n"
+					 " WHERE {\n"
+					 "  VALUES ?ref {");
+		for(c = base; c < end; c++)
+		{
+			p += sprintf(p, " <%s>", data->refs[c]);
+		}
+		p += sprintf(p, " }\n"
+					 "  GRAPH ?g {\n"
+					 "  { ?ref ?p ?o .\n"
+					 "   BIND(?ref as ?s)\n"
+					 "  }\n");
+		if(data->generate->describeinbound)
 		{
-			break;
+			p += sprintf(p, "  UNION\n"
+						 "  { ?s ?p ?ref .\n"
+						 "   FILTER(?p != <" NS_RDF "type>)\n"
+						 "   BIND(?ref as ?o)\n"
+						 "  }\n");
 		}
+		sprintf(p, " }\n"
+				"}");
+		spindle_stats_sparql(data->spindle, strlen(qbuf));
+		r = sparql_query_model(data->sparql, qbuf, strlen(qbuf), data->sourcedata);
+		free(qbuf);
 	}
 	return r;
 }
@@ -234,6 +258,7 @@ spindle_source_fetch_sparql_(SPINDLEENTRY *data)
 	 * Note that this includes data in both the root and proxy graphs,
 	 * but they will be removed by spindle_cache_source_clean_().
 	 */
+	spindle_stats_sparql(data->spindle, 0);
 	if(sparql_queryf_model(data->sparql, data->sourcedata,
 						   "SELECT DISTINCT ?s ?p ?o ?g\n"
 						   " WHERE {\n"
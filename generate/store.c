@@ -53,6 +53,7 @@ spindle_store_sparql_(SPINDLEENTRY *entry)
 	 * <external> owl:sameAs <proxy>, so we can delete <proxy> ?p ?o with
 	 * impunity.
 	 */
+	spindle_stats_sparql(entry->spindle, 0);
 	if(sparql_updatef(entry->sparql,
 					  "WITH %V\n"
 					  " DELETE { %V ?p ?o }\n"
@@ -62,6 +63,7 @@ spindle_store_sparql_(SPINDLEENTRY *entry)
 		twine_logf(LOG_ERR, PLUGIN_NAME ": failed to delete previously-cached triples\n");
 		return -1;
 	}
+	spindle_stats_sparql(entry->spindle, 0);
 	if(sparql_updatef(entry->sparql,
 					  "WITH %V\n"
 					  " DELETE { %V ?p ?o }\n"
@@ -71,6 +73,7 @@ spindle_store_sparql_(SPINDLEENTRY *entry)
 		twine_logf(LOG_ERR, PLUGIN_NAME ": failed to delete previously-cached triples\n");
 		return -1;
 	}
+	spindle_stats_sparql(entry->spindle, 0);
 	if(sparql_insert_model(entry->sparql, entry->rootdata))
 	{
 		twine_logf(LOG_ERR, PLUGIN_NAME ": failed to push new proxy data into the root graph of the store\n");
@@ -81,6 +84,7 @@ spindle_store_sparql_(SPINDLEENTRY *entry)
 	if(entry->spindle->multigraph)
 	{
 		triples = twine_rdf_model_ntriples(entry->proxydata, &triplen);
+		spindle_stats_sparql(entry->spindle, triplen);
 		if(sparql_put(entry->sparql, entry->graphname, triples, triplen))
 		{
 			twine_logf(LOG_ERR, PLUGIN_NAME ": failed to push new proxy data into the store\n");
@@ -91,6 +95,7 @@ spindle_store_sparql_(SPINDLEENTRY *entry)
 	}
 	else
 	{
+		spindle_stats_sparql(entry->spindle, 0);
 		if(sparql_updatef(entry->sparql,
 						  "WITH %V\n"
 						  " DELETE { %V ?p ?o }\n"
@@ -101,6 +106,7 @@ spindle_store_sparql_(SPINDLEENTRY *entry)
 			return -1;
 		}
 		/* Insert the new proxy triples, if any */
+		spindle_stats_sparql(entry->spindle, 0);
 		if(sparql_insert_model(entry->sparql, entry->proxydata))
 		{
 			twine_logf(LOG_ERR, PLUGIN_NAME ": failed to push new proxy data into the store\n");
@@ -72,43 +72,30 @@ spindle_trigger_add(SPINDLEENTRY *cache, const char *uri, unsigned int kind, con
 int
 spindle_trigger_apply(SPINDLEENTRY *entry)
 {
-	SQL_STATEMENT *rs;
-	int flags;
-	const char *id;
+	int priority, count;
 
 	if(!entry->generate->db)
 	{
 		return 0;
 	}
-	rs = sql_queryf(entry->generate->db, "SELECT \"id\", \"flags\", \"triggerid\" FROM \"triggers\" WHERE \"triggerid\" = %Q AND \"triggerid\" <> \"id\"", entry->id);
-	if(!rs)
+	/* Trigger updates that have this entry's flag in scope; the targets
+	 * are queued no more urgently than this entry, and coalesced with
+	 * any regeneration which is already pending or in progress
+	 */
+	priority = entry->priority;
+	if(priority < SPINDLE_PRIO_TRIGGER)
+	{
+		priority = SPINDLE_PRIO_TRIGGER;
+	}
+	count = spindle_db_state_trigger(entry->spindle, entry->generate->db, entry->id, entry->flags, priority);
+	if(count < 0)
 	{
 		return -1;
 	}
-	for(; !sql_stmt_eof(rs); sql_stmt_next(rs))
+	if(count)
 	{
-		// Get the id of the target
-		id = sql_stmt_str(rs, 0);
-
-		// Get the flags to apply
-		flags = (int) sql_stmt_long(rs, 1);
-
-		/* Trigger updates that have this entry's flag in scope */
-		if (entry->flags & flags)
-		{
-			// Do a logical OR if there is already a trigger scheduled (status = DIRTY and flags <> 0)
-			sql_executef(entry->generate->db, "UPDATE \"state\" SET \"flags\" = \"flags\" | %d WHERE \"id\" = %Q AND \"flags\" <> 0 AND \"status\" = 'DIRTY'", flags, id);
-
-			// Set the flag in case we set a previously completed or rejected resource (status != DIRTY)
-			sql_executef(entry->generate->db, "UPDATE \"state\" SET \"flags\" = %d WHERE \"id\" = %Q AND \"status\" <> 'DIRTY'", flags, id);
-
-			// Set the target as DIRTY
-			sql_executef(entry->generate->db, "UPDATE \"state\" SET \"status\" = %Q WHERE \"id\" = %Q", "DIRTY", id);
-		}
+		twine_logf(LOG_DEBUG, PLUGIN_NAME ": triggered updates of %d entities\n", count);
 	}
-
-	sql_stmt_destroy(rs);
-
 	return 0;
 }
 
@@ -116,26 +103,35 @@ spindle_trigger_apply(SPINDLEENTRY *entry)
 int
 spindle_triggers_update(SPINDLEENTRY *data)
 {
+	const char **uris;
+	char *array;
 	size_t c;
+	int r;
 
 	if(!data->generate->spindle->db)
 	{
 		return 0;
 	}
-	if(sql_executef(data->generate->spindle->db, "UPDATE \"triggers\" SET \"triggerid\" = %Q WHERE \"uri\" = %Q",
-		data->id, data->localname))
+	uris = (const char **) calloc(data->refcount + 1, sizeof(const char *));
+	if(!uris)
 	{
 		return -1;
 	}
+	uris[0] = data->localname;
 	for(c = 0; c < data->refcount; c++)
 	{
-		if(sql_executef(data->generate->spindle->db, "UPDATE \"triggers\" SET \"triggerid\" = %Q WHERE \"uri\" = %Q",
-			data->id, data->refs[c]))
-		{
-			return -1;
-		}
+		uris[c + 1] = data->refs[c];
 	}
-	return 0;
+	array = spindle_db_strarray(uris, data->refcount + 1);
+	free(uris);
+	if(!array)
+	{
+		return -1;
+	}
+	r = spindle_db_executef(data->generate->spindle->db, "UPDATE \"triggers\" SET \"triggerid\" = %Q WHERE \"uri\" = ANY(%Q::text[]) AND \"triggerid\" IS DISTINCT FROM %Q",
+		data->id, array, data->id);
+	free(array);
+	return r ? -1 : 0;
 }
 
 /* Add the set of trigger URIs to the database
@@ -148,31 +144,65 @@ spindle_triggers_update(SPINDLEENTRY *data)
  * Returns:
  *   0 on success
  *   -1 on failure
+ *
+ * All of the triggers are written by a single statement, which skips any
+ * whose target already triggers this entity and replaces any existing
+ * entry for the same (id, uri).
  */
 int
 spindle_triggers_index(SQL *sql, const char *id, SPINDLEENTRY *data)
 {
+	const char **list;
+	char *uris, *ids, *kinds, *p;
 	size_t c;
-	SQL_STATEMENT *rs;
+	int r;
 
+	if(!data->ntriggers)
+	{
+		return 0;
+	}
+	list = (const char **) calloc(data->ntriggers, sizeof(const char *));
+	/* {n,n,...} where each n is an unsigned int */
+	kinds = (char *) malloc(data->ntriggers * 12 + 3);
+	if(!list || !kinds)
+	{
+		free(list);
+		free(kinds);
+		return -1;
+	}
+	p = kinds;
+	*p = '{';
+	p++;
 	for(c = 0; c < data->ntriggers; c++)
 	{
-		// Check if we are about to create a loop
-		rs = sql_queryf(sql, "SELECT \"id\" FROM \"triggers\" WHERE \"id\" = %Q AND \"triggerid\" = %Q", data->triggers[c].id, id);
-		if(!rs)
-		{
-			return -1;
-		}
-		if(sql_stmt_eof(rs)) {
-			if(sql_executef(sql, "INSERT INTO \"triggers\" (\"id\", \"uri\", \"flags\", \"triggerid\") VALUES (%Q, %Q, '%d', %Q)",
-				id, data->triggers[c].uri, data->triggers[c].kind, data->triggers[c].id))
-			{
-				sql_stmt_destroy(rs);
-				return -1;
-			}
-		}
-		sql_stmt_destroy(rs);
+		list[c] = data->triggers[c].uri;
+		p += sprintf(p, "%s%u", (c ? "," : ""), data->triggers[c].kind);
 	}
-	return 0;
+	strcpy(p, "}");
+	uris = spindle_db_strarray(list, data->ntriggers);
+	for(c = 0; c < data->ntriggers; c++)
+	{
+		list[c] = data->triggers[c].id;
+	}
+	ids = spindle_db_strarray(list, data->ntriggers);
+	free(list);
+	if(!uris || !ids)
+	{
+		free(uris);
+		free(ids);
+		free(kinds);
+		return -1;
+	}
+	r = spindle_db_executef(sql, "INSERT INTO \"triggers\" (\"id\", \"uri\", \"flags\", \"triggerid\") "
+		"SELECT %Q, \"t\".\"uri\", \"t\".\"flags\", \"t\".\"triggerid\" "
+		"FROM unnest(%Q::text[], %Q::integer[], %Q::uuid[]) AS \"t\" (\"uri\", \"flags\", \"triggerid\") "
+		"WHERE NOT EXISTS ("
+		" SELECT 1 FROM \"triggers\" \"x\" WHERE \"x\".\"id\" = \"t\".\"triggerid\" AND \"x\".\"triggerid\" = %Q"
+		") "
+		"ON CONFLICT (\"id\", \"uri\") DO UPDATE SET \"flags\" = EXCLUDED.\"flags\", \"triggerid\" = EXCLUDED.\"triggerid\"",
+		id, uris, kinds, ids, id);
+	free(uris);
+	free(ids);
+	free(kinds);
+	return r ? -1 : 0;
 }
-